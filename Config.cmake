@@ -96,6 +96,20 @@ set(CMAKE_CXX_FLAGS "-W -Wall -Wextra -pedantic\
   -DDATABASE_${DATABASE_U} \
   -DBOOST_LOG_DYN_LINK")
 
+# Persist the high-volume C++ model objects with ODB bulk operations. This
+# requires ODB 2.5 (checked after finding ODB) and libpq with pipeline mode
+# support (PostgreSQL 14 or newer). SQLite doesn't support bulk operations.
+option(WITH_ODB_BULK "Use ODB bulk operations in the parser." OFF)
+if (WITH_ODB_BULK AND NOT DATABASE_U STREQUAL "PGSQL")
+  message(FATAL_ERROR
+    "WITH_ODB_BULK requires DATABASE=pgsql, ODB doesn't support bulk "
+    "operations on ${DATABASE}.")
+endif()
+if (WITH_ODB_BULK)
+  list(APPEND ODBFLAGS -DODB_BULK)
+  set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -DODB_BULK")
+endif()
+
 # Gold is the primary linker 
 if(NOT DEFINED CODECOMPASS_LINKER)
     set(CODECOMPASS_LINKER "gold")
@@ -91,6 +91,14 @@ set(ODB_EXECUTABLE ${odb_BIN} CACHE STRING "ODB executable")
 
 mark_as_advanced(libodb_INCLUDE_DIR libodb_LIBRARY odb_BIN)
 
+if(ODB_EXECUTABLE)
+	execute_process(
+		COMMAND ${ODB_EXECUTABLE} --version
+		OUTPUT_VARIABLE _odbVersionOutput
+		ERROR_QUIET)
+	string(REGEX MATCH "[0-9]+\\.[0-9]+\\.[0-9]+" ODB_VERSION "${_odbVersionOutput}")
+endif()
+
 if(ODB_LIBODB_INCLUDE_DIRS AND ODB_LIBODB_LIBRARIES)
 	set(ODB_LIBODB_FOUND TRUE)
 endif()
@@ -107,6 +115,7 @@ include(FindPackageHandleStandardArgs)
 find_package_handle_standard_args(ODB
 	FOUND_VAR ODB_FOUND
 	REQUIRED_VARS ODB_EXECUTABLE ODB_LIBODB_FOUND
+	VERSION_VAR ODB_VERSION
 	HANDLE_COMPONENTS)
 
 string(TOLOWER "${DATABASE}" _databaseLib)
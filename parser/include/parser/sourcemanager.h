@@ -1,13 +1,13 @@
 #ifndef CC_PARSER_SOURCEMANAGER_H
 #define CC_PARSER_SOURCEMANAGER_H
 
+#include <array>
 #include <memory>
 #include <mutex>
 #include <string>
-#include <map>
+#include <unordered_map>
 #include <unordered_set>
-
-#include <magic.h>
+#include <vector>
 
 #include <model/file.h>
 #include <model/file-odb.hxx>
@@ -35,10 +35,7 @@ public:
   /**
    * This function returns the number of cached files.
    */
-  std::map<std::string, model::FilePtr>::size_type numberOfFiles()
-  {
-    return _files.size();
-  }
+  std::size_t numberOfFiles();
 
   /**
    * This function (re)populates the cache with the files that are
@@ -75,9 +72,20 @@ public:
 
   /**
    * This function returns true if the given file is a plain text file.
+   *
+   * Files with a well-known source extension are classified by scanning their
+   * first few kilobytes for NUL and control characters. Files with a NUL
+   * character in this sample are reported binary right away. Other files are
+   * examined with libmagic through a cookie owned by the calling thread, so
+   * parser threads don't serialize on this function.
    */
   bool isPlainText(const std::string& path_) const;
 
+  /**
+   * This function persists the files which have been created since the
+   * previous call. Only these new entries are visited, so the cost of a call
+   * doesn't depend on the number of files already known.
+   */
   // TODO: Maybe this function shouldn't exist.
   void persistFiles();
 
@@ -89,6 +97,43 @@ public:
   void removeFile(const model::File& file_);
 
 private:
+  /**
+   * The file cache is partitioned into this many independently locked shards.
+   * A path always belongs to the same shard (see shardOf()), so parser threads
+   * looking up different files rarely contend on the same mutex.
+   */
+  static constexpr std::size_t NUM_SHARDS = 64;
+
+  struct FileShard
+  {
+    std::mutex mutex;
+
+    /**
+     * Canonical path -> model::File mapping.
+     */
+    std::unordered_map<std::string, model::FilePtr> files;
+
+    /**
+     * Memoized results of boost::filesystem::canonical(): path as given by the
+     * caller -> canonical path. Only successful canonicalizations are stored.
+     */
+    std::unordered_map<std::string, std::string> canonicalPaths;
+  };
+
+  /**
+   * This function returns the shard which is responsible for the given path.
+   */
+  FileShard& shardOf(const std::string& path_);
+
+  /**
+   * This function returns the canonical form of the given path. The result is
+   * memoized so subsequent calls with the same path don't touch the file
+   * system.
+   * @param exists_ Set to false if the file doesn't exist on the disk. In this
+   * case the original path is returned.
+   */
+  std::string getCanonicalPath(const std::string& path_, bool& exists_);
+
   /**
    * This function creates a model::FileContent object and fills its attributes
    * based on the given path.
@@ -123,11 +168,26 @@ private:
 
   std::shared_ptr<odb::database> _db;
   util::OdbTransaction _transaction;
-  std::map<std::string, model::FilePtr> _files;
+  std::array<FileShard, NUM_SHARDS> _shards;
+
+  /**
+   * The bookkeeping of persisted objects is guarded by _persistMutex. The lock
+   * order is _persistMutex, then a shard or _dirtyMutex: reloadCache() and
+   * persistFiles() lock those while holding _persistMutex, but the lookups
+   * never take _persistMutex, so database writes don't block them.
+   */
   std::unordered_set<model::FileId> _persistedFiles;
   std::unordered_set<std::string> _persistedContents;
-  std::mutex _createFileMutex;
-  ::magic_t _magicCookie;
+  std::mutex _persistMutex;
+  std::size_t _numPersistedFiles;
+
+  /**
+   * Files which have been placed in the cache but not persisted yet. This list
+   * has its own lock because it is appended by the lookups.
+   */
+  std::vector<model::FilePtr> _dirtyFiles;
+  std::mutex _dirtyMutex;
+
 };
 
 template<typename Filter>
@@ -135,9 +195,14 @@ std::vector<model::FilePtr> SourceManager::getFiles(const Filter& beta_)
 {
   std::vector<model::FilePtr> files;
 
-  for (const auto& p: _files)
-    if (beta_(p.second))
-      files.push_back(p.second);
+  for (FileShard& shard : _shards)
+  {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+
+    for (const auto& p : shard.files)
+      if (beta_(p.second))
+        files.push_back(p.second);
+  }
 
   return files;
 }
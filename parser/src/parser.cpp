@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <ctime>
 #include <memory>
 #include <string>
 #include <vector>
@@ -13,6 +15,9 @@
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 
+#include <model/statistics.h>
+#include <model/statistics-odb.hxx>
+
 #include <util/dbutil.h>
 #include <util/filesystem.h>
 #include <util/logutil.h>
@@ -213,6 +218,40 @@ void incrementalCleanup(cc::parser::ParserContext& ctx_)
   }
 }
 
+/**
+ * Increments the parse generation stamp in the statistics table. The services
+ * drop their caches when this value changes. A new or recreated database
+ * starts from the current time, so that a forced reparse doesn't reuse the
+ * stamp of the previous database.
+ * @param db_ Database of the project.
+ */
+void bumpParseGeneration(std::shared_ptr<odb::database> db_)
+{
+  typedef odb::query<cc::model::Statistics> StatQuery;
+
+  cc::util::OdbTransaction {db_} ([&]
+  {
+    cc::model::StatisticsPtr stat = db_->query_one<cc::model::Statistics>(
+      StatQuery::group == "Parser" && StatQuery::key == "Generation");
+
+    int now = static_cast<int>(std::time(nullptr));
+
+    if (stat)
+    {
+      stat->value = std::max(stat->value + 1, now);
+      db_->update(*stat);
+    }
+    else
+    {
+      cc::model::Statistics generation;
+      generation.group = "Parser";
+      generation.key = "Generation";
+      generation.value = now;
+      db_->persist(generation);
+    }
+  });
+}
+
 int main(int argc, char* argv[])
 {
   std::string compassRoot = cc::util::binaryPathToInstallDir(argv[0]);
@@ -438,6 +477,8 @@ int main(int argc, char* argv[])
     pHandler.getParser(pluginName)->parse();
   }
 
+  bumpParseGeneration(db);
+
   //--- Create project config file ---//
 
   boost::property_tree::ptree pt;
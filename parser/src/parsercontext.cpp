@@ -1,10 +1,9 @@
-#include <fstream>
-
 #include <boost/filesystem.hpp>
 
 #include <model/file.h>
 #include <model/file-odb.hxx>
 
+#include <util/filesystem.h>
 #include <util/hash.h>
 #include <util/odbtransaction.h>
 
@@ -52,11 +51,8 @@ ParserContext::ParserContext(
 
            fileHashes[file->path] = content->hash;
 
-           std::ifstream fileStream(file->path);
-           std::string fileContent(
-             std::istreambuf_iterator<char>{fileStream},
-             std::istreambuf_iterator<char>{});
-           fileStream.close();
+           std::string fileContent;
+           util::readFile(file->path, fileContent);
 
            if (content->hash != util::sha1Hash(fileContent))
            {
@@ -1,55 +1,191 @@
-#include <fstream>
 #include <algorithm>
+#include <cstring>
+
+#include <fstream>
 
 #include <boost/filesystem.hpp>
 
+#include <magic.h>
+
+#include <util/filesystem.h>
 #include <util/hash.h>
 #include <util/logutil.h>
 #include <util/dbutil.h>
 
 #include <parser/sourcemanager.h>
 
-namespace cc
-{
-namespace parser
+namespace
 {
 
-SourceManager::SourceManager(std::shared_ptr<odb::database> db_)
-  : _db(db_), _transaction(db_), _magicCookie(nullptr)
+/**
+ * Extensions of files which are text files unless their content says
+ * otherwise.
+ */
+const std::unordered_set<std::string> textExtensions = {
+  ".c", ".cc", ".cpp", ".cxx", ".c++", ".C", ".h", ".hh", ".hpp", ".hxx",
+  ".h++", ".H", ".inc", ".inl", ".ipp", ".tcc", ".txx", ".def", ".s", ".S",
+  ".asm", ".java", ".py", ".js", ".ts", ".go", ".rs", ".cs", ".pl", ".pm",
+  ".rb", ".sh", ".bash", ".cmake", ".txt", ".md", ".rst", ".json", ".xml",
+  ".yml", ".yaml", ".html", ".htm", ".css", ".y", ".l", ".ll", ".td",
+  ".proto", ".thrift", ".sql", ".ini", ".cfg", ".conf", ".in", ".am", ".ac",
+  ".mk"};
+
+/**
+ * Number of bytes from the beginning of a file examined by the classifier.
+ */
+constexpr std::size_t sampleSize = 4096;
+
+enum class TextClass
 {
-  //--- Reload files from database ---//
+  Text,
+  Binary,
+  Unknown
+};
+
+/**
+ * This function classifies a file based on its extension and its first
+ * sampleSize bytes.
+ */
+TextClass classifyText(const std::string& path_)
+{
+  char sample[sampleSize];
+
+  std::ifstream ifs(path_, std::ios::binary);
+  ifs.read(sample, sampleSize);
+  std::size_t size = static_cast<std::size_t>(ifs.gcount());
+
+  // libmagic doesn't consider empty files text.
+  if (size == 0)
+    return TextClass::Unknown;
+
+  // UTF-16 and UTF-32 text contains NUL bytes, so files starting with their
+  // byte order mark are left to libmagic. The UTF-32 LE mark starts with the
+  // UTF-16 LE one.
+  if (size >= 2 &&
+      ((sample[0] == '\xff' && sample[1] == '\xfe') ||
+       (sample[0] == '\xfe' && sample[1] == '\xff')))
+    return TextClass::Unknown;
+
+  if (size >= 4 &&
+      sample[0] == '\0' && sample[1] == '\0' &&
+      sample[2] == '\xfe' && sample[3] == '\xff')
+    return TextClass::Unknown;
+
+  // This loop is written without early exit so that the compiler can
+  // vectorize it.
+  std::size_t nuls = 0;
+  std::size_t controls = 0;
+
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    unsigned char c = static_cast<unsigned char>(sample[i]);
+    nuls += c == 0;
+    controls += (c < 0x20 && (c < '\t' || c > '\r')) || c == 0x7f;
+  }
 
-  reloadCache();
+  if (nuls)
+    return TextClass::Binary;
+
+  if (!controls &&
+      textExtensions.count(boost::filesystem::extension(path_)))
+    return TextClass::Text;
 
-  //--- Initialize magic for plain text testing ---//
+  return TextClass::Unknown;
+}
 
-  if ((_magicCookie = ::magic_open(MAGIC_SYMLINK)))
+/**
+ * A libmagic cookie which belongs to one thread.
+ */
+class MagicCookie
+{
+public:
+  MagicCookie() : _cookie(::magic_open(MAGIC_SYMLINK))
   {
-    if (::magic_load(_magicCookie, 0) != 0)
+    if (!_cookie)
+    {
+      LOG(warning) << "Failed to create a libmagic cookie!";
+      return;
+    }
+
+    if (::magic_load(_cookie, 0) != 0)
     {
       LOG(warning)
         << "libmagic error: "
-        << ::magic_error(_magicCookie);
+        << ::magic_error(_cookie);
 
-      ::magic_close(_magicCookie);
-      _magicCookie = nullptr;
+      ::magic_close(_cookie);
+      _cookie = nullptr;
     }
   }
-  else
-    LOG(warning) << "Failed to create a libmagic cookie!";
+
+  ~MagicCookie()
+  {
+    if (_cookie)
+      ::magic_close(_cookie);
+  }
+
+  ::magic_t get() const { return _cookie; }
+
+private:
+  ::magic_t _cookie;
+};
+
+} // namespace
+
+namespace cc
+{
+namespace parser
+{
+
+SourceManager::SourceManager(std::shared_ptr<odb::database> db_)
+  : _db(db_), _transaction(db_), _numPersistedFiles(0)
+{
+  //--- Reload files from database ---//
+
+  reloadCache();
 }
 
 SourceManager::~SourceManager()
 {
   persistFiles();
 
-  if (_magicCookie)
-    ::magic_close(_magicCookie);
+  LOG(info) << "Persisted " << _numPersistedFiles << " new file(s).";
+}
+
+std::size_t SourceManager::numberOfFiles()
+{
+  std::size_t size = 0;
+
+  for (FileShard& shard : _shards)
+  {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    size += shard.files.size();
+  }
+
+  return size;
+}
+
+SourceManager::FileShard& SourceManager::shardOf(const std::string& path_)
+{
+  return _shards[std::hash<std::string>()(path_) % NUM_SHARDS];
 }
 
 void SourceManager::reloadCache()
 {
-  _files.clear();
+  std::lock_guard<std::mutex> persistGuard(_persistMutex);
+
+  for (FileShard& shard : _shards)
+  {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    shard.files.clear();
+    shard.canonicalPaths.clear();
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(_dirtyMutex);
+    _dirtyFiles.clear();
+  }
+
   _persistedFiles.clear();
   _persistedContents.clear();
 
@@ -57,7 +193,10 @@ void SourceManager::reloadCache()
 
     for (const model::File& file : _db->query<model::File>())
     {
-      _files[file.path] = std::make_shared<model::File>(file);
+      FileShard& shard = shardOf(file.path);
+
+      std::lock_guard<std::mutex> guard(shard.mutex);
+      shard.files[file.path] = std::make_shared<model::File>(file);
       _persistedFiles.insert(file.id);
     }
 
@@ -69,31 +208,26 @@ void SourceManager::reloadCache()
 model::FileContentPtr SourceManager::createFileContent(
   const std::string& path_) const
 {
-  std::ifstream ifs(path_);
-  if (!ifs)
+  model::FileContentPtr content = std::make_shared<model::FileContent>();
+
+  // Get content
+  if (!util::readFile(path_, content->content))
   {
     LOG(error) << "Failed to open '" << path_ << "'";
     return nullptr;
   }
 
-  model::FileContentPtr content = std::make_shared<model::FileContent>();
-
-  // Get length of file
-  ifs.seekg(0, std::ios::end);
-  auto fileSize = ifs.tellg();
-  ifs.seekg(0, std::ios::beg);
-
-  // Get content
-  content->content.reserve(fileSize);
-  content->content.assign(
-    std::istreambuf_iterator<char>(ifs),
-    std::istreambuf_iterator<char>());
-
   // A file may contain 0x00 characters (e.g. in an RTF file). If we store these
   // files in a PostgreSQL database then we get 'invalid byte sequence' errors.
   // FIXME: Convert file content from the file's encoding to the DB's encoding.
   // FIXME: I'm not sure that SPACE character is the best replacement.
-  std::replace(content->content.begin(), content->content.end(), '\0', ' ');
+  // memchr() is used for skipping to the next 0x00 since it is vectorized in
+  // the standard library, and these characters are rare.
+  char* it = &content->content[0];
+  char* end = it + content->content.size();
+
+  while ((it = static_cast<char*>(std::memchr(it, '\0', end - it))))
+    *it++ = ' ';
 
   // Generate hash
   content->hash = util::sha1Hash(content->content);
@@ -107,17 +241,15 @@ model::FilePtr SourceManager::getCreateFileEntry(
 {
   //--- Return from cache if it contains ---//
 
-  _createFileMutex.lock();
-  std::map<std::string, model::FilePtr>::const_iterator it = _files.find(path_);
+  FileShard& shard = shardOf(path_);
 
-  if (it != _files.end())
   {
-    model::FilePtr file = it->second;
-    _createFileMutex.unlock();
-    return file;
-  }
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto it = shard.files.find(path_);
 
-  _createFileMutex.unlock();
+    if (it != shard.files.end())
+      return it->second;
+  }
 
   //--- Create new file entry ---//
 
@@ -156,37 +288,71 @@ model::FilePtr SourceManager::getCreateFileEntry(
       file->content = createFileContent(path_);
   }
 
+  //--- Place it in the cache unless another thread was faster ---//
+
+  {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto inserted = shard.files.emplace(path_, file);
+
+    if (!inserted.second)
+      return inserted.first->second;
+  }
+
+  std::lock_guard<std::mutex> guard(_dirtyMutex);
+  _dirtyFiles.push_back(file);
+
   return file;
 }
 
-model::FilePtr SourceManager::getFile(const std::string& path_)
+std::string SourceManager::getCanonicalPath(
+  const std::string& path_,
+  bool& exists_)
 {
-  //--- Create canonical form of the path ---//
+  FileShard& shard = shardOf(path_);
+
+  {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto it = shard.canonicalPaths.find(path_);
+
+    if (it != shard.canonicalPaths.end())
+    {
+      exists_ = true;
+      return it->second;
+    }
+  }
 
   boost::system::error_code ec;
   boost::filesystem::path canonicalPath
     = boost::filesystem::canonical(path_, ec);
 
-  //--- If the file can't be found on disk then return nullptr ---//
-
-  bool fileExists = true;
   if (ec)
   {
-    LOG(debug) << "File doesn't exist: " << path_;
-    fileExists = false;
+    exists_ = false;
+    return path_;
   }
 
-  //--- Create file entry ---//
+  exists_ = true;
 
-  std::string canonical = ec ? path_ : canonicalPath.native();
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  shard.canonicalPaths.emplace(path_, canonicalPath.native());
+  return canonicalPath.native();
+}
 
-  model::FilePtr file = getCreateFileEntry(canonical, fileExists);
+model::FilePtr SourceManager::getFile(const std::string& path_)
+{
+  //--- Create canonical form of the path ---//
 
-  _createFileMutex.lock();
-  _files[canonical] = file;
-  _createFileMutex.unlock();
+  bool fileExists;
+  std::string canonical = getCanonicalPath(path_, fileExists);
 
-  return file;
+  //--- If the file can't be found on disk then return nullptr ---//
+
+  if (!fileExists)
+    LOG(debug) << "File doesn't exist: " << path_;
+
+  //--- Create file entry ---//
+
+  return getCreateFileEntry(canonical, fileExists);
 }
 
 model::FilePtr SourceManager::getCreateParent(const std::string& path_)
@@ -202,10 +368,22 @@ model::FilePtr SourceManager::getCreateParent(const std::string& path_)
 
 bool SourceManager::isPlainText(const std::string& path_) const
 {
-  static std::mutex _magicFileMutex;
-  std::lock_guard<std::mutex> guard(_magicFileMutex);
+  switch (classifyText(path_))
+  {
+    case TextClass::Text:
+      return true;
+    case TextClass::Binary:
+      return false;
+    case TextClass::Unknown:
+      break;
+  }
 
-  const char* magic = ::magic_file(_magicCookie, path_.c_str());
+  thread_local MagicCookie magicCookie;
+
+  if (!magicCookie.get())
+    return false;
+
+  const char* magic = ::magic_file(magicCookie.get(), path_.c_str());
 
   if (!magic)
   {
@@ -221,9 +399,9 @@ bool SourceManager::isPlainText(const std::string& path_) const
 
 void SourceManager::updateFile(const model::File& file_)
 {
-  _createFileMutex.lock();
+  _persistMutex.lock();
   bool find = _persistedFiles.find(file_.id) != _persistedFiles.end();
-  _createFileMutex.unlock();
+  _persistMutex.unlock();
 
   if (find)
     _transaction([&]() {
@@ -252,8 +430,23 @@ void SourceManager::removeFile(const model::File& file_)
 
   // Maintain cache
   {
-    std::lock_guard<std::mutex> guard(_createFileMutex);
-    _files.erase(file_.path);
+    FileShard& shard = shardOf(file_.path);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    shard.files.erase(file_.path);
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(_dirtyMutex);
+    _dirtyFiles.erase(
+      std::remove_if(_dirtyFiles.begin(), _dirtyFiles.end(),
+        [&file_](const model::FilePtr& dirty_) {
+          return dirty_->id == file_.id;
+        }),
+      _dirtyFiles.end());
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(_persistMutex);
     _persistedFiles.erase(file_.id);
     if (removeContent)
       _persistedContents.erase(file_.content.object_id());
@@ -262,29 +455,45 @@ void SourceManager::removeFile(const model::File& file_)
 
 void SourceManager::persistFiles()
 {
-  std::lock_guard<std::mutex> guard(_createFileMutex);
+  std::lock_guard<std::mutex> persistGuard(_persistMutex);
+
+  //--- Take the entries created since the last call ---//
+
+  std::vector<model::FilePtr> dirty;
+
+  {
+    std::lock_guard<std::mutex> guard(_dirtyMutex);
+    dirty.swap(_dirtyFiles);
+  }
+
+  std::vector<model::FilePtr> batch;
+  batch.reserve(dirty.size());
+
+  for (model::FilePtr& file : dirty)
+    if (_persistedFiles.insert(file->id).second)
+      batch.push_back(std::move(file));
+
+  if (batch.empty())
+    return;
+
+  //--- Persist them in one transaction without blocking the lookups ---//
 
   _transaction([&]() {
-    for (const auto& p : _files)
+    for (const model::FilePtr& file : batch)
     {
-      if (_persistedFiles.find(p.second->id) == _persistedFiles.end())
-        _persistedFiles.insert(p.second->id);
-      else
-        continue;
-
       try
       {
         // Directories don't have content.
-        if (p.second->content &&
-            _persistedContents.find(p.second->content.object_id()) ==
+        if (file->content &&
+            _persistedContents.find(file->content.object_id()) ==
             _persistedContents.end())
         {
-          p.second->content.load();
-          _db->persist(*p.second->content);
-          _persistedContents.insert(p.second->content.object_id());
+          file->content.load();
+          _db->persist(*file->content);
+          _persistedContents.insert(file->content.object_id());
         }
 
-        _db->persist(*p.second);
+        _db->persist(*file);
 
         // TODO: The memory consumption should be checked to see if not
         // unloading the lazy shared pointer keeps the file content in memory.
@@ -292,13 +501,19 @@ void SourceManager::persistFiles()
         // unloading is that some parsers may want to read the file contents and
         // if this can be done through the File object then the file is not
         // needed to be read from disk.
-        p.second->content.unload();
+        file->content.unload();
       }
       catch (const odb::object_already_persistent&)
       {
       }
     }
   });
+
+  _numPersistedFiles += batch.size();
+
+  LOG(debug)
+    << "Persisted " << batch.size() << " new file(s), "
+    << _numPersistedFiles << " in total.";
 }
 
 } // parser
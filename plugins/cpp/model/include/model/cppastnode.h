@@ -20,7 +20,11 @@ namespace model
 
 typedef std::uint64_t CppAstNodeId;
 
+#ifdef ODB_BULK
+#pragma db object bulk(5000)
+#else
 #pragma db object
+#endif
 struct CppAstNode
 {
   enum class SymbolType
@@ -86,7 +90,8 @@ struct CppAstNode
   bool operator==(const CppAstNode& other) const { return id == other.id; }
 
 #pragma db index("location_file_idx") member(location.file)
-#pragma db index("entityHash_astType_idx") members(entityHash, astType)
+#pragma db index("entityHash_astType_idx") \
+  members(entityHash, astType, location.file, id)
 #pragma db index("astType_symbolType_idx") members(astType, symbolType)
 };
 
@@ -242,6 +247,43 @@ struct CppAstNodeFilePath
   std::string path;
 };
 
+#pragma db view object(CppAstNode)
+struct CppAstNodeSpan
+{
+  #pragma db column(CppAstNode::id)
+  CppAstNodeId id;
+
+  #pragma db column(CppAstNode::location.range)
+  Range range;
+
+  #pragma db column(CppAstNode::symbolType)
+  CppAstNode::SymbolType symbolType;
+
+  #pragma db column(CppAstNode::visibleInSourceCode)
+  bool visibleInSourceCode;
+};
+
+/**
+ * Counts the distinct function definitions (Caller) enclosing the selected
+ * AST nodes (Callee) in the same file.
+ */
+#pragma db view \
+  object(CppAstNode = Caller) \
+  object(CppAstNode = Callee : \
+    Caller::location.file == Callee::location.file && \
+    (Caller::location.range.start.line < Callee::location.range.start.line || \
+     (Caller::location.range.start.line == Callee::location.range.start.line && \
+      Caller::location.range.start.column <= \
+        Callee::location.range.start.column)) && \
+    (Caller::location.range.end.line > Callee::location.range.end.line || \
+     (Caller::location.range.end.line == Callee::location.range.end.line && \
+      Caller::location.range.end.column > Callee::location.range.end.column)))
+struct CppAstCallerCount
+{
+  #pragma db column("count(DISTINCT " + Caller::id + ")")
+  std::size_t count;
+};
+
 #pragma db view object(CppAstNode)
 struct CppAstCount
 {
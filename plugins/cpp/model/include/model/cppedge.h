@@ -16,7 +16,11 @@ namespace model
 
 typedef std::uint64_t CppEdgeId;
 
+#ifdef ODB_BULK
+#pragma db object bulk(5000)
+#else
 #pragma db object
+#endif
 struct CppEdge
 {
   /**
@@ -88,7 +92,11 @@ inline std::uint64_t createIdentifier(const CppEdge& edge_)
 
 typedef std::uint64_t CppEdgeAttributeId;
 
+#ifdef ODB_BULK
+#pragma db object bulk(5000)
+#else
 #pragma db object
+#endif
 struct CppEdgeAttribute
 {
   #pragma db id
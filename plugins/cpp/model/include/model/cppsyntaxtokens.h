@@ -0,0 +1,67 @@
+#ifndef CC_MODEL_CPPSYNTAXTOKENS_H
+#define CC_MODEL_CPPSYNTAXTOKENS_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <odb/core.hxx>
+
+#include <model/file.h>
+
+namespace cc
+{
+namespace model
+{
+
+/**
+ * One syntax highlighted occurrence of a visible AST node's value in a line.
+ * The symbol and AST types are the values of CppAstNode::SymbolType and
+ * CppAstNode::AstType.
+ */
+struct CppSyntaxToken
+{
+  std::uint32_t line;
+  std::uint32_t column;
+  std::uint32_t length;
+  std::uint16_t symbolType;
+  std::uint16_t astType;
+};
+
+struct CppSyntaxTokens;
+typedef std::shared_ptr<CppSyntaxTokens> CppSyntaxTokensPtr;
+
+/**
+ * The syntax highlight of a file, computed by the C++ parser. The tokens
+ * column stores an array of CppSyntaxToken records in native byte order,
+ * sorted by line and column.
+ */
+#pragma db object
+struct CppSyntaxTokens
+{
+  #pragma db id
+  FileId file;
+
+  /**
+   * Number of AST nodes in the file at the time the tokens were computed.
+   */
+  std::size_t astNodeCount;
+
+  #pragma db not_null pgsql:type("BYTEA") sqlite:type("BLOB")
+  std::vector<char> tokens;
+};
+
+#pragma db view object(CppSyntaxTokens)
+struct CppSyntaxTokensAstNodeCount
+{
+  #pragma db column(CppSyntaxTokens::file)
+  FileId file;
+
+  #pragma db column(CppSyntaxTokens::astNodeCount)
+  std::size_t astNodeCount;
+};
+
+} // model
+} // cc
+
+#endif // CC_MODEL_CPPSYNTAXTOKENS_H
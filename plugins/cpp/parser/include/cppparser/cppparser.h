@@ -2,7 +2,9 @@
 #define CC_PARSER_CXXPARSER_H
 
 #include <map>
+#include <mutex>
 #include <set>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -111,8 +113,45 @@ private:
   std::vector<std::vector<std::string>> createCleanupOrder();
   bool cleanupWorker(const std::string& path_);
 
+  /**
+   * This function orders the compile commands so that the translation units
+   * which are expected to take the longest time to parse come first. The
+   * expected cost is the parse time recorded by the previous run. Translation
+   * units without history are estimated by their file size.
+   */
+  void orderByCost(
+    std::vector<clang::tooling::CompileCommand>& commands_) const;
+
+  /**
+   * The path of the file in the project directory which stores the parse
+   * time of each translation unit between runs.
+   */
+  std::string parseTimesFile() const;
+  void loadParseTimes();
+  void saveParseTimes() const;
+
+  /**
+   * This function computes the syntax highlight tokens (see
+   * model::CppSyntaxTokens) of the files whose AST nodes have changed since
+   * the tokens were last computed.
+   */
+  void persistSyntaxTokens();
+  void syntaxTokensWorker(model::FileId file_);
+
+  /**
+   * The path of the file in the project directory which stores the snapshot
+   * of the entity cache between runs (see EntityCache::saveSnapshot()).
+   */
+  std::string entityCacheFile() const;
+
   std::unordered_set<std::uint64_t> _parsedCommandHashes;
 
+  /**
+   * Parse time of translation units in milliseconds by source file path.
+   */
+  std::unordered_map<std::string, std::uint64_t> _parseTimes;
+  std::mutex _parseTimesMutex;
+
 };
 
 } // parser
@@ -5,11 +5,13 @@
 #include <mutex>
 #include <type_traits>
 #include <stack>
+#include <unordered_set>
 #include <functional>
 
 #include <clang/Basic/SourceLocation.h>
 #include <clang/Basic/SourceManager.h>
 #include <clang/AST/Decl.h>
+#include <clang/AST/DeclTemplate.h>
 #include <clang/AST/RecursiveASTVisitor.h>
 #include <clang/AST/ParentMapContext.h>
 #include <llvm/Support/raw_ostream.h>
@@ -43,6 +45,7 @@
 
 #include <cppparser/filelocutil.h>
 
+#include "databasewriter.h"
 #include "entitycache.h"
 #include "symbolhelper.h"
 #include "nestedscope.h"
@@ -78,7 +81,10 @@ public:
     ParserContext& ctx_,
     clang::ASTContext& astContext_,
     EntityCache& entityCache_,
-    std::unordered_map<const void*, model::CppAstNodeId>& clangToAstNodeId_)
+    DatabaseWriter& dbWriter_,
+    std::unordered_map<const void*, model::CppAstNodeId>& clangToAstNodeId_,
+    const std::unordered_set<unsigned>& indexedElsewhere_,
+    DatabaseWriter::Task onCommitted_ = DatabaseWriter::Task())
     : _isImplicit(false),
       _ctx(ctx_),
       _clangSrcMgr(astContext_.getSourceManager()),
@@ -87,7 +93,10 @@ public:
       _mngCtx(astContext_.createMangleContext()),
       _cppSourceType("CPP"),
       _entityCache(entityCache_),
-      _clangToAstNodeId(clangToAstNodeId_)
+      _dbWriter(dbWriter_),
+      _clangToAstNodeId(clangToAstNodeId_),
+      _indexedElsewhere(indexedElsewhere_),
+      _onCommitted(std::move(onCommitted_))
   {
   }
 
@@ -115,21 +124,36 @@ public:
         _astNodes.push_back(typeLocAstNode);
     }
 
-    (util::OdbTransaction(_ctx.db))([this]{
-      util::persistAll(_astNodes, _ctx.db);
-      util::persistAll(_enumConstants, _ctx.db);
-      util::persistAll(_enums, _ctx.db);
-      util::persistAll(_types, _ctx.db);
-      util::persistAll(_typedefs, _ctx.db);
-      util::persistAll(_variables, _ctx.db);
-      util::persistAll(_namespaces, _ctx.db);
-      util::persistAll(_namespaceAliases, _ctx.db);
-      util::persistAll(_members, _ctx.db);
-      util::persistAll(_inheritances, _ctx.db);
-      util::persistAll(_friends, _ctx.db);
-      util::persistAll(_functions, _ctx.db);
-      util::persistAll(_relations, _ctx.db);
-    });
+    _dbWriter.enqueue([
+      db = _ctx.db,
+      astNodes = std::move(_astNodes),
+      enumConstants = std::move(_enumConstants),
+      enums = std::move(_enums),
+      types = std::move(_types),
+      typedefs = std::move(_typedefs),
+      variables = std::move(_variables),
+      namespaces = std::move(_namespaces),
+      namespaceAliases = std::move(_namespaceAliases),
+      members = std::move(_members),
+      inheritances = std::move(_inheritances),
+      friends = std::move(_friends),
+      functions = std::move(_functions),
+      relations = std::move(_relations)]() mutable
+    {
+      util::persistAllBulk(astNodes, db);
+      util::persistAll(enumConstants, db);
+      util::persistAll(enums, db);
+      util::persistAll(types, db);
+      util::persistAll(typedefs, db);
+      util::persistAll(variables, db);
+      util::persistAll(namespaces, db);
+      util::persistAll(namespaceAliases, db);
+      util::persistAll(members, db);
+      util::persistAll(inheritances, db);
+      util::persistAll(friends, db);
+      util::persistAll(functions, db);
+      util::persistAll(relations, db);
+    }, std::move(_onCommitted));
   }
 
 
@@ -281,6 +305,19 @@ public:
     
     if (clang::FunctionDecl* fd = llvm::dyn_cast<clang::FunctionDecl>(d_))
     {
+      if (isIndexedElsewhere(fd))
+      {
+        // The methods overriding a virtual method in other header fragments
+        // or in the main file refer to its AST node in their Override
+        // relations, so its id is needed even though the node itself has been
+        // persisted by another translation unit.
+        clang::CXXMethodDecl* md = llvm::dyn_cast<clang::CXXMethodDecl>(fd);
+        if (md && md->isVirtual())
+          insertToCache(md, createFunctionAstNode(md));
+
+        return true;
+      }
+
       // Any type of function must be placed on the function stack
       // for the duration of its traversal.
       // The scope creates a database object for the function
@@ -304,6 +341,36 @@ public:
   }
 
 
+  /**
+   * This function returns true if the given function is in a header fragment
+   * which has already been indexed by another translation unit in the same
+   * preprocessor context (see HeaderFragmentCallback). Such functions would
+   * produce the same model objects again. Templates and their instantiations
+   * are never skipped, because their instances depend on the translation unit.
+   * The AST node ids of skipped virtual methods are still recorded for the
+   * Override relations of the methods overriding them (see TraverseDecl()).
+   */
+  bool isIndexedElsewhere(const clang::FunctionDecl* fd_) const
+  {
+    if (_indexedElsewhere.empty() || _isImplicit)
+      return false;
+
+    if (fd_->isTemplated() ||
+        fd_->getTemplatedKind() != clang::FunctionDecl::TK_NonTemplate ||
+        fd_->getTemplateSpecializationKind() != clang::TSK_Undeclared)
+      return false;
+
+    for (const clang::DeclContext* dc = fd_->getDeclContext();
+         dc; dc = dc->getParent())
+      if (llvm::isa<clang::ClassTemplateSpecializationDecl>(dc))
+        return false;
+
+    clang::FileID fid = _clangSrcMgr.getFileID(
+      _clangSrcMgr.getExpansionLoc(fd_->getLocation()));
+
+    return _indexedElsewhere.count(fid.getHashValue());
+  }
+
   // Metrics helpers
 
   void CountMcCabe()
@@ -857,18 +924,7 @@ public:
   {
     //--- CppAstNode ---//
 
-    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
-
-    astNode->astValue = getSignature(fn_);
-    astNode->location = getFileLoc(fn_->getBeginLoc(), fn_->getEndLoc());
-    astNode->entityHash = util::fnvHash(getUSR(fn_));
-    astNode->symbolType = model::CppAstNode::SymbolType::Function;
-    astNode->astType
-      = fn_->isThisDeclarationADefinition()
-      ? model::CppAstNode::AstType::Definition
-      : model::CppAstNode::AstType::Declaration;
-
-    astNode->id = model::createIdentifier(*astNode);
+    model::CppAstNodePtr astNode = createFunctionAstNode(fn_);
 
     if (insertToCache(fn_, astNode))
       _astNodes.push_back(astNode);
@@ -1562,6 +1618,30 @@ private:
    * @return If the insertion was successful (i.e. the cache didn't contain the
    * id before) then the function returns true.
    */
+  /**
+   * This function creates the AST node of a function declaration. It is also
+   * used for the functions skipped by isIndexedElsewhere(), so their ids are
+   * the same as those persisted by the translation unit which has indexed
+   * them.
+   */
+  model::CppAstNodePtr createFunctionAstNode(clang::FunctionDecl* fn_)
+  {
+    model::CppAstNodePtr astNode = std::make_shared<model::CppAstNode>();
+
+    astNode->astValue = getSignature(fn_);
+    astNode->location = getFileLoc(fn_->getBeginLoc(), fn_->getEndLoc());
+    astNode->entityHash = util::fnvHash(getUSR(fn_));
+    astNode->symbolType = model::CppAstNode::SymbolType::Function;
+    astNode->astType
+      = fn_->isThisDeclarationADefinition()
+      ? model::CppAstNode::AstType::Definition
+      : model::CppAstNode::AstType::Declaration;
+
+    astNode->id = model::createIdentifier(*astNode);
+
+    return astNode;
+  }
+
   bool insertToCache(const void* clangPtr_, model::CppAstNodePtr node_)
   {
     _clangToAstNodeId[clangPtr_] = node_->id;
@@ -1841,7 +1921,10 @@ private:
   std::unordered_map<std::string, model::FilePtr> _files;
 
   EntityCache& _entityCache;
+  DatabaseWriter& _dbWriter;
   std::unordered_map<const void*, model::CppAstNodeId>& _clangToAstNodeId;
+  const std::unordered_set<unsigned>& _indexedElsewhere;
+  DatabaseWriter::Task _onCommitted;
 
   // clang::TypeLoc for type names is like clang::DeclRefExpr for objects: it
   // represents their occurrences in the source code. Type names may occur in
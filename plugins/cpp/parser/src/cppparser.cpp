@@ -1,9 +1,16 @@
 #include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
 #include <numeric>
 #include <fstream>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <random>
+#include <sstream>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <boost/algorithm/string/join.hpp>
@@ -21,6 +28,10 @@
 #include <model/buildsourcetarget-odb.hxx>
 #include <model/file.h>
 #include <model/file-odb.hxx>
+#include <model/cppsyntaxtokens.h>
+#include <model/cppsyntaxtokens-odb.hxx>
+#include <model/statistics.h>
+#include <model/statistics-odb.hxx>
 
 #include <util/hash.h>
 #include <util/logutil.h>
@@ -30,8 +41,10 @@
 #include <cppparser/cppparser.h>
 
 #include "clangastvisitor.h"
+#include "databasewriter.h"
 #include "relationcollector.h"
 #include "entitycache.h"
+#include "headerfragments.h"
 #include "ppincludecallback.h"
 #include "ppmacrocallback.h"
 #include "doccommentcollector.h"
@@ -44,20 +57,201 @@ namespace parser
 
 namespace fs = boost::filesystem;
 
+namespace
+{
+
+bool isWordChar(char c_)
+{
+  return std::isalnum(static_cast<unsigned char>(c_)) || c_ == '_';
+}
+
+/**
+ * This function appends the occurrences of the node's value as a whole word
+ * in the lines of the node to tokens_. This is the same as matching the
+ * \b<value>\b regular expression in each line.
+ */
+void collectSyntaxTokens(
+  const model::CppAstNode& node_,
+  const std::vector<std::string>& lines_,
+  std::vector<model::CppSyntaxToken>& tokens_)
+{
+  const std::string& value = node_.astValue;
+
+  // A word boundary is between a word and a non-word character.
+  bool valueStartsWord = isWordChar(value.front());
+  bool valueEndsWord = isWordChar(value.back());
+
+  for (std::size_t i = node_.location.range.start.line - 1;
+       i < node_.location.range.end.line && i < lines_.size();
+       ++i)
+  {
+    const std::string& line = lines_[i];
+
+    std::size_t pos = line.find(value);
+    while (pos != std::string::npos)
+    {
+      std::size_t end = pos + value.size();
+
+      bool before = pos > 0 && isWordChar(line[pos - 1]);
+      bool after = end < line.size() && isWordChar(line[end]);
+
+      if (before != valueStartsWord && after != valueEndsWord)
+      {
+        tokens_.push_back(model::CppSyntaxToken{
+          static_cast<std::uint32_t>(i + 1),
+          static_cast<std::uint32_t>(pos + 1),
+          static_cast<std::uint32_t>(value.size()),
+          static_cast<std::uint16_t>(node_.symbolType),
+          static_cast<std::uint16_t>(node_.astType)});
+
+        pos = line.find(value, end);
+      }
+      else
+        pos = line.find(value, pos + 1);
+    }
+  }
+}
+
+/**
+ * The statistics row holding the stamp of the entity cache snapshot. The stamp
+ * is a random value written to the database and to the snapshot at the same
+ * time, so a snapshot is only loaded for the database state it was saved for.
+ * A database which is rebuilt (e.g. by --force) has no such row.
+ */
+const char* const SNAPSHOT_STAMP_GROUP = "CppParser";
+const char* const SNAPSHOT_STAMP_KEY = "EntityCacheSnapshot";
+
+/**
+ * This function returns the snapshot stamp of the database or 0 if there is
+ * none. It has to be called in a transaction.
+ */
+std::uint64_t querySnapshotStamp(odb::database& db_)
+{
+  typedef odb::query<model::Statistics> StatQuery;
+
+  model::StatisticsPtr stat = db_.query_one<model::Statistics>(
+    StatQuery::group == SNAPSHOT_STAMP_GROUP &&
+    StatQuery::key == SNAPSHOT_STAMP_KEY);
+
+  return stat ? static_cast<std::uint64_t>(stat->value) : 0;
+}
+
+/**
+ * This function stores a new random snapshot stamp in the database.
+ * @return The new stamp.
+ */
+std::uint64_t updateSnapshotStamp(std::shared_ptr<odb::database> db_)
+{
+  typedef odb::query<model::Statistics> StatQuery;
+
+  std::random_device rd;
+  int stamp = std::uniform_int_distribution<int>(
+    1, std::numeric_limits<int>::max())(rd);
+
+  util::OdbTransaction {db_} ([&] {
+    model::StatisticsPtr stat = db_->query_one<model::Statistics>(
+      StatQuery::group == SNAPSHOT_STAMP_GROUP &&
+      StatQuery::key == SNAPSHOT_STAMP_KEY);
+
+    if (stat)
+    {
+      stat->value = stamp;
+      db_->update(*stat);
+    }
+    else
+    {
+      model::Statistics newStat;
+      newStat.group = SNAPSHOT_STAMP_GROUP;
+      newStat.key = SNAPSHOT_STAMP_KEY;
+      newStat.value = stamp;
+      db_->persist(newStat);
+    }
+  });
+
+  return static_cast<std::uint64_t>(stamp);
+}
+
+} // namespace
+
 class VisitorActionFactory : public clang::tooling::FrontendActionFactory
 {
 public:
-  static void cleanUp()
+  static void cleanUp(ParserContext& ctx_, const std::string& snapshot_)
   {
+    // The destructor of the writer blocks until every result is persisted.
+    MyFrontendAction::_dbWriter.reset();
+
+    try
+    {
+      std::uint64_t stamp = updateSnapshotStamp(ctx_.db);
+
+      if (!MyFrontendAction::_entityCache.saveSnapshot(snapshot_, stamp))
+        LOG(warning) << "[cppparser] Failed to write " << snapshot_;
+    }
+    catch (const odb::exception& ex)
+    {
+      LOG(warning)
+        << "[cppparser] Failed to store the entity cache snapshot stamp: "
+        << ex.what();
+    }
+
     MyFrontendAction::_entityCache.clear();
+    MyFrontendAction::_fragmentRegistry.clear();
   }
 
-  static void init(ParserContext& ctx_)
+  static void init(ParserContext& ctx_, const std::string& snapshot_)
   {
+    EntityCache& cache = MyFrontendAction::_entityCache;
+
+    //--- Load the snapshot of the previous parse ---//
+
+    // The AST nodes of the files removed by the incremental cleanup are
+    // deleted from the database by cascade. The id of a file is the hash of
+    // its path (see SourceManager).
+    std::unordered_set<model::FileId> staleFiles;
+    for (const auto& status : ctx_.fileStatus)
+      if (status.second != IncrementalStatus::ADDED)
+        staleFiles.insert(util::fnvHash(status.first));
+
     util::OdbTransaction {ctx_.db} ([&] {
+      std::uint64_t stamp = querySnapshotStamp(*ctx_.db);
+
+      bool loaded = stamp && cache.loadSnapshot(snapshot_, stamp, staleFiles);
+
+      if (loaded)
+      {
+        std::size_t count = ctx_.db->query_value<model::CppAstCount>().count;
+
+        if (count == cache.size())
+        {
+          LOG(debug)
+            << "[cppparser] Loaded " << count
+            << " AST node(s) from entity cache snapshot.";
+          return;
+        }
+
+        LOG(warning)
+          << "[cppparser] Entity cache snapshot is out of date, "
+             "reading the AST nodes from the database.";
+        cache.clear();
+      }
+
       for (const model::CppAstNode& node : ctx_.db->query<model::CppAstNode>())
-        MyFrontendAction::_entityCache.insert(node);
+        cache.insert(node);
     });
+
+    // The snapshot is valid only until this parse modifies the database.
+    boost::system::error_code ec;
+    fs::remove(snapshot_, ec);
+
+    std::size_t writers = ctx_.options["db-writers"].as<int>();
+#ifdef DATABASE_SQLITE
+    // SQLite serializes the writers anyway.
+    writers = std::min<std::size_t>(writers, 1);
+#endif
+
+    MyFrontendAction::_dbWriter = std::make_unique<DatabaseWriter>(
+      ctx_.db, writers, 4 * ctx_.options["jobs"].as<int>());
   }
 
   VisitorActionFactory(ParserContext& ctx_) : _ctx(ctx_)
@@ -76,29 +270,51 @@ private:
     MyConsumer(
       ParserContext& ctx_,
       clang::ASTContext& context_,
-      EntityCache& entityCache_)
-        : _entityCache(entityCache_), _ctx(ctx_), _context(context_)
+      EntityCache& entityCache_,
+      DatabaseWriter& dbWriter_,
+      HeaderFragmentRegistry& fragmentRegistry_,
+      const std::unordered_set<unsigned>& indexedElsewhere_,
+      const std::vector<std::uint64_t>& indexedHere_)
+        : _entityCache(entityCache_),
+          _dbWriter(dbWriter_),
+          _fragmentRegistry(fragmentRegistry_),
+          _indexedElsewhere(indexedElsewhere_),
+          _indexedHere(indexedHere_),
+          _ctx(ctx_),
+          _context(context_)
     {
     }
 
     virtual void HandleTranslationUnit(clang::ASTContext& context_) override
     {
+      // The header fragments indexed by this translation unit may be skipped
+      // by the others only when its functions are in the database.
+      DatabaseWriter::Task onCommitted;
+
+      if (!_indexedHere.empty())
+        onCommitted = [&registry = _fragmentRegistry,
+                       fragments = _indexedHere]()
+        {
+          registry.markIndexed(fragments);
+        };
+
       {
         ClangASTVisitor clangAstVisitor(
-          _ctx, _context, _entityCache, _clangToAstNodeId);
+          _ctx, _context, _entityCache, _dbWriter, _clangToAstNodeId,
+          _indexedElsewhere, std::move(onCommitted));
         clangAstVisitor.TraverseDecl(context_.getTranslationUnitDecl());
       }
 
       {
         RelationCollector relationCollector(
-          _ctx, _context);
+          _ctx, _context, _dbWriter);
         relationCollector.TraverseDecl(context_.getTranslationUnitDecl());
       }
 
       if (!_ctx.options.count("skip-doccomment"))
       {
         DocCommentCollector docCommentCollector(
-          _ctx, _context, _entityCache, _clangToAstNodeId);
+          _ctx, _context, _entityCache, _dbWriter, _clangToAstNodeId);
         docCommentCollector.TraverseDecl(context_.getTranslationUnitDecl());
       }
       else
@@ -107,6 +323,10 @@ private:
 
   private:
     EntityCache& _entityCache;
+    DatabaseWriter& _dbWriter;
+    HeaderFragmentRegistry& _fragmentRegistry;
+    const std::unordered_set<unsigned>& _indexedElsewhere;
+    const std::vector<std::uint64_t>& _indexedHere;
     std::unordered_map<const void*, model::CppAstNodeId> _clangToAstNodeId;
 
     ParserContext& _ctx;
@@ -129,9 +349,13 @@ private:
       auto& pp = compiler_.getPreprocessor();
 
       pp.addPPCallbacks(std::make_unique<PPIncludeCallback>(
-        _ctx, compiler_.getASTContext(), _entityCache, pp));
+        _ctx, compiler_.getASTContext(), _entityCache, *_dbWriter, pp));
       pp.addPPCallbacks(std::make_unique<PPMacroCallback>(
-        _ctx, compiler_.getASTContext(), _entityCache, pp));
+        _ctx, compiler_.getASTContext(), _entityCache, *_dbWriter, pp));
+
+      if (_ctx.options.count("skip-indexed-headers"))
+        pp.addPPCallbacks(std::make_unique<HeaderFragmentCallback>(
+          _ctx, pp, _fragmentRegistry, _indexedElsewhere, _indexedHere));
 
       return true;
     }
@@ -140,19 +364,38 @@ private:
       clang::CompilerInstance& compiler_, llvm::StringRef) override
     {
       return std::unique_ptr<clang::ASTConsumer>(
-        new MyConsumer(_ctx, compiler_.getASTContext(), _entityCache));
+        new MyConsumer(
+          _ctx, compiler_.getASTContext(), _entityCache, *_dbWriter,
+          _fragmentRegistry, _indexedElsewhere, _indexedHere));
     }
 
   private:
     static EntityCache _entityCache;
+    static std::unique_ptr<DatabaseWriter> _dbWriter;
+    static HeaderFragmentRegistry _fragmentRegistry;
 
     ParserContext& _ctx;
+
+    /**
+     * Hash values of the clang::FileID of the header fragments in this
+     * translation unit which have already been indexed by another one.
+     */
+    std::unordered_set<unsigned> _indexedElsewhere;
+
+    /**
+     * The header fragments in this translation unit which haven't been
+     * indexed by another one yet.
+     */
+    std::vector<std::uint64_t> _indexedHere;
   };
 
   ParserContext& _ctx;
 };
 
 EntityCache VisitorActionFactory::MyFrontendAction::_entityCache;
+std::unique_ptr<DatabaseWriter>
+  VisitorActionFactory::MyFrontendAction::_dbWriter;
+HeaderFragmentRegistry VisitorActionFactory::MyFrontendAction::_fragmentRegistry;
 
 bool CppParser::isSourceFile(const std::string& file_) const
 {
@@ -654,6 +897,10 @@ bool CppParser::cleanupWorker(const std::string& path_)
             // Delete CppEdge (connected to File)
             _ctx.db->erase_query<model::CppEdge>(odb::query<model::CppEdge>::from == delFile->id);
 
+            // Delete CppSyntaxTokens
+            _ctx.db->erase_query<model::CppSyntaxTokens>(
+              odb::query<model::CppSyntaxTokens>::file == delFile->id);
+
             break;
           }
 
@@ -687,7 +934,8 @@ bool CppParser::cleanupWorker(const std::string& path_)
 bool CppParser::parse()
 {
   initBuildActions();
-  VisitorActionFactory::init(_ctx);
+  loadParseTimes();
+  VisitorActionFactory::init(_ctx, entityCacheFile());
 
   bool success = true;
 
@@ -697,12 +945,229 @@ bool CppParser::parse()
       success
         = success && parseByJson(input, _ctx.options["jobs"].as<int>());
 
-  VisitorActionFactory::cleanUp();
+  VisitorActionFactory::cleanUp(_ctx, entityCacheFile());
+  saveParseTimes();
+  persistSyntaxTokens();
   _parsedCommandHashes.clear();
+  _parseTimes.clear();
 
   return success;
 }
 
+std::string CppParser::parseTimesFile() const
+{
+  return _ctx.options["workspace"].as<std::string>() + '/'
+    + _ctx.options["name"].as<std::string>() + "/cppparser/parsetimes";
+}
+
+void CppParser::persistSyntaxTokens()
+{
+  typedef odb::query<model::AstCountGroupByFiles> CountQuery;
+
+  //--- Collect the files with missing or outdated highlight ---//
+
+  std::vector<model::FileId> files;
+
+  util::OdbTransaction {_ctx.db} ([&] {
+    std::unordered_map<model::FileId, std::size_t> computed;
+
+    for (const model::CppSyntaxTokensAstNodeCount& tokens
+      : _ctx.db->query<model::CppSyntaxTokensAstNodeCount>())
+      computed[tokens.file] = tokens.astNodeCount;
+
+    for (const model::AstCountGroupByFiles& count
+      : _ctx.db->query<model::AstCountGroupByFiles>(CountQuery(true)))
+    {
+      auto it = computed.find(count.file);
+      if (it == computed.end() || it->second != count.count)
+        files.push_back(count.file);
+    }
+  });
+
+  //--- Compute the tokens of the files in parallel ---//
+
+  std::unique_ptr<util::JobQueueThreadPool<model::FileId>> pool =
+    util::make_thread_pool<model::FileId>(
+      _ctx.options["jobs"].as<int>(), [this](model::FileId file_)
+      {
+        try
+        {
+          syntaxTokensWorker(file_);
+        }
+        catch (const odb::exception& ex)
+        {
+          LOG(warning)
+            << "[cppparser] Failed to store the syntax highlight of file "
+            << file_ << ": " << ex.what();
+        }
+      });
+
+  for (model::FileId file : files)
+    pool->enqueue(file);
+
+  pool->wait();
+
+  LOG(debug)
+    << "[cppparser] Computed the syntax highlight of " << files.size()
+    << " file(s).";
+}
+
+void CppParser::syntaxTokensWorker(model::FileId file_)
+{
+  typedef odb::query<model::CppAstNode> AstQuery;
+
+  util::OdbTransaction {_ctx.db} ([&] {
+    model::FilePtr file = _ctx.db->find<model::File>(file_);
+
+    if (!file || !file->content.load())
+      return;
+
+    std::vector<std::string> lines;
+    std::istringstream ss(file->content->content);
+    std::string line;
+    while (std::getline(ss, line))
+      lines.push_back(std::move(line));
+
+    std::size_t astNodeCount = 0;
+    std::vector<model::CppSyntaxToken> tokens;
+
+    for (const model::CppAstNode& node : _ctx.db->query<model::CppAstNode>(
+      AstQuery::location.file == file_))
+    {
+      ++astNodeCount;
+
+      if (node.visibleInSourceCode &&
+          !node.astValue.empty() &&
+          node.location.range.end.line != model::Position::npos)
+        collectSyntaxTokens(node, lines, tokens);
+    }
+
+    std::stable_sort(tokens.begin(), tokens.end(),
+      [](const model::CppSyntaxToken& lhs_, const model::CppSyntaxToken& rhs_)
+      {
+        return lhs_.line < rhs_.line ||
+          (lhs_.line == rhs_.line && lhs_.column < rhs_.column);
+      });
+
+    model::CppSyntaxTokens syntaxTokens;
+    syntaxTokens.file = file_;
+    syntaxTokens.astNodeCount = astNodeCount;
+    syntaxTokens.tokens.resize(tokens.size() * sizeof(model::CppSyntaxToken));
+    std::memcpy(
+      syntaxTokens.tokens.data(), tokens.data(), syntaxTokens.tokens.size());
+
+    _ctx.db->erase_query<model::CppSyntaxTokens>(
+      odb::query<model::CppSyntaxTokens>::file == file_);
+    _ctx.db->persist(syntaxTokens);
+  });
+}
+
+std::string CppParser::entityCacheFile() const
+{
+  return _ctx.options["workspace"].as<std::string>() + '/'
+    + _ctx.options["name"].as<std::string>() + "/cppparser/entitycache";
+}
+
+void CppParser::loadParseTimes()
+{
+  std::ifstream ifs(parseTimesFile());
+
+  std::uint64_t time;
+  std::string path;
+
+  // Each line contains the parse time in milliseconds and the path of the
+  // source file, separated by a space.
+  while (ifs >> time && ifs.get() == ' ' && std::getline(ifs, path))
+    _parseTimes[path] = time;
+
+  LOG(debug)
+    << "[cppparser] Loaded parse times of " << _parseTimes.size()
+    << " translation unit(s).";
+}
+
+void CppParser::saveParseTimes() const
+{
+  fs::path file(parseTimesFile());
+
+  boost::system::error_code ec;
+  fs::create_directories(file.parent_path(), ec);
+
+  std::ofstream ofs(file.native());
+  if (!ofs)
+  {
+    LOG(warning) << "[cppparser] Failed to write " << file.native();
+    return;
+  }
+
+  for (const auto& parseTime : _parseTimes)
+    ofs << parseTime.second << ' ' << parseTime.first << '\n';
+}
+
+void CppParser::orderByCost(
+  std::vector<clang::tooling::CompileCommand>& commands_) const
+{
+  auto sourcePath = [](const clang::tooling::CompileCommand& command_)
+  {
+    return fs::absolute(command_.Filename, command_.Directory).native();
+  };
+
+  //--- Collect the known parse times and file sizes ---//
+
+  std::vector<std::uint64_t> sizes;
+  std::vector<const std::uint64_t*> times;
+  sizes.reserve(commands_.size());
+  times.reserve(commands_.size());
+
+  double knownTime = 0;
+  double knownSize = 0;
+
+  for (const clang::tooling::CompileCommand& command : commands_)
+  {
+    std::string path = sourcePath(command);
+
+    boost::system::error_code ec;
+    std::uint64_t size = fs::file_size(path, ec);
+    sizes.push_back(ec ? 0 : size);
+
+    auto it = _parseTimes.find(path);
+    times.push_back(it == _parseTimes.end() ? nullptr : &it->second);
+
+    if (it != _parseTimes.end())
+    {
+      knownTime += it->second;
+      knownSize += sizes.back();
+    }
+  }
+
+  //--- Estimate the cost of each command ---//
+
+  // Translation units without history are estimated by the parse speed of
+  // the ones with history.
+  double timePerByte = knownSize > 0 ? knownTime / knownSize : 1.0;
+
+  std::vector<std::pair<double, std::size_t>> costs;
+  costs.reserve(commands_.size());
+
+  for (std::size_t i = 0; i < commands_.size(); ++i)
+    costs.emplace_back(times[i] ? *times[i] : sizes[i] * timePerByte, i);
+
+  std::stable_sort(costs.begin(), costs.end(),
+    [](const auto& lhs_, const auto& rhs_)
+    {
+      return lhs_.first > rhs_.first;
+    });
+
+  //--- Reorder the commands ---//
+
+  std::vector<clang::tooling::CompileCommand> ordered;
+  ordered.reserve(commands_.size());
+
+  for (const auto& cost : costs)
+    ordered.push_back(std::move(commands_[cost.second]));
+
+  commands_.swap(ordered);
+}
+
 void CppParser::initBuildActions()
 {
   util::OdbTransaction {_ctx.db} ([&] {
@@ -759,6 +1224,10 @@ bool CppParser::parseByJson(
       }),
     compileCommands.end());
 
+  // Start the most expensive translation units first so that the parse
+  // doesn't end with a few long jobs keeping the other threads idle.
+  orderByCost(compileCommands);
+
   std::size_t numCompileCommands = compileCommands.size();
 
   //--- Create a thread pool for the current commands ---//
@@ -773,8 +1242,20 @@ bool CppParser::parseByJson(
           << '(' << job_.index << '/' << numCompileCommands << ')'
           << " Parsing " << command.Filename;
 
+        auto start = std::chrono::steady_clock::now();
+
         int error = this->parseWorker(command);
 
+        std::uint64_t time =
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+        {
+          std::lock_guard<std::mutex> lock(_parseTimesMutex);
+          _parseTimes[
+            fs::absolute(command.Filename, command.Directory).native()] = time;
+        }
+
         if (error)
           LOG(warning)
             << '(' << job_.index << '/' << numCompileCommands << ')'
@@ -833,7 +1314,17 @@ extern "C"
     description.add_options()
       ("skip-doccomment",
        "If this flag is given the parser will skip parsing the documentation "
-       "comments.");
+       "comments.")
+      ("skip-indexed-headers",
+       "If this flag is given the functions of a header file are indexed only "
+       "once for every distinct preprocessor context in which it is included, "
+       "instead of once in every translation unit including it.")
+      ("db-writers",
+       boost::program_options::value<int>()->default_value(2),
+       "Number of threads persisting the results of the C++ parser. The "
+       "parser threads hand over their results to these threads and continue "
+       "with the next translation unit. If 0 then the parser threads write "
+       "the database themselves.");
     return description;
   }
 
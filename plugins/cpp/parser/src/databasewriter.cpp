@@ -0,0 +1,185 @@
+#include <string>
+
+#include <util/logutil.h>
+#include <util/odbtransaction.h>
+
+#include "databasewriter.h"
+
+namespace
+{
+  /**
+   * The name of the savepoint which separates the tasks of a transaction.
+   */
+  const std::string TASK_SAVEPOINT = "cc_write_task";
+}
+
+namespace cc
+{
+namespace parser
+{
+
+DatabaseWriter::DatabaseWriter(
+  std::shared_ptr<odb::database> db_,
+  std::size_t writers_,
+  std::size_t capacity_)
+    : _db(db_),
+      _capacity(capacity_ ? capacity_ : 1),
+      _die(false)
+{
+  for (std::size_t i = 0; i < writers_; ++i)
+    _threads.emplace_back(&DatabaseWriter::writer, this);
+}
+
+DatabaseWriter::~DatabaseWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _die = true;
+  }
+
+  _notEmpty.notify_all();
+
+  for (std::thread& t : _threads)
+    t.join();
+}
+
+void DatabaseWriter::enqueue(Task task_, Task onCommitted_)
+{
+  Entry entry{std::move(task_), std::move(onCommitted_)};
+
+  // The tasks are enqueued from destructors, so errors must not propagate to
+  // the caller even if there are no writer threads.
+  if (_threads.empty())
+  {
+    std::vector<Entry> batch;
+    batch.push_back(std::move(entry));
+    write(batch);
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+    _notFull.wait(lock, [this]{ return _queue.size() < _capacity; });
+    _queue.push_back(std::move(entry));
+  }
+
+  _notEmpty.notify_one();
+}
+
+void DatabaseWriter::writer()
+{
+  std::vector<Entry> batch;
+  batch.reserve(MAX_BATCH_SIZE);
+
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      _notEmpty.wait(lock, [this]{ return !_queue.empty() || _die; });
+
+      // The remaining tasks are written before the thread exits.
+      if (_queue.empty())
+        break;
+
+      while (!_queue.empty() && batch.size() < MAX_BATCH_SIZE)
+      {
+        batch.push_back(std::move(_queue.front()));
+        _queue.pop_front();
+      }
+    }
+
+    _notFull.notify_all();
+
+    write(batch);
+    batch.clear();
+  }
+}
+
+void DatabaseWriter::write(std::vector<Entry>& batch_)
+{
+  std::vector<bool> written(batch_.size(), false);
+  bool committed = false;
+
+  try
+  {
+    util::OdbTransaction {_db} ([&, this]{
+      for (std::size_t i = 0; i < batch_.size(); ++i)
+        written[i] = writeTask(batch_[i]);
+    });
+
+    committed = true;
+  }
+  catch (const std::exception& ex)
+  {
+    LOG(warning)
+      << "Writing " << batch_.size() << " task(s) in one transaction failed, "
+      << "retrying one by one: " << ex.what();
+  }
+  catch (...)
+  {
+    LOG(warning)
+      << "Writing " << batch_.size() << " task(s) in one transaction failed, "
+      << "retrying one by one.";
+  }
+
+  for (std::size_t i = 0; i < batch_.size(); ++i)
+  {
+    if (!committed)
+    {
+      try
+      {
+        util::OdbTransaction {_db} ([&, this]{
+          written[i] = writeTask(batch_[i]);
+        });
+      }
+      catch (const std::exception& ex)
+      {
+        LOG(error) << "Database write failed: " << ex.what();
+        continue;
+      }
+      catch (...)
+      {
+        LOG(error) << "Database write failed.";
+        continue;
+      }
+    }
+
+    if (written[i] && batch_[i].onCommitted)
+      batch_[i].onCommitted();
+  }
+}
+
+bool DatabaseWriter::writeTask(Entry& entry_)
+{
+  _db->execute("SAVEPOINT " + TASK_SAVEPOINT);
+
+  try
+  {
+    entry_.task();
+
+    // On PostgreSQL an error aborts the transaction, and every further
+    // statement fails until it is rolled back. util::persistAll() only logs
+    // some of these errors, so the release of the savepoint is what finds out
+    // that the task hasn't been written.
+    _db->execute("RELEASE SAVEPOINT " + TASK_SAVEPOINT);
+    return true;
+  }
+  catch (const std::exception& ex)
+  {
+    LOG(error) << "Database write failed: " << ex.what();
+  }
+  catch (...)
+  {
+    LOG(error) << "Database write failed.";
+  }
+
+  // If this fails too then the transaction is unusable, and the exception
+  // makes write() retry the tasks in their own transactions.
+  _db->execute("ROLLBACK TO SAVEPOINT " + TASK_SAVEPOINT);
+  _db->execute("RELEASE SAVEPOINT " + TASK_SAVEPOINT);
+
+  return false;
+}
+
+} // parser
+} // cc
@@ -0,0 +1,112 @@
+#ifndef CC_PARSER_DATABASEWRITER_H
+#define CC_PARSER_DATABASEWRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <odb/database.hxx>
+
+namespace cc
+{
+namespace parser
+{
+
+/**
+ * Thread safe queue of database write tasks.
+ *
+ * Parser threads hand over the objects collected from a translation unit in a
+ * write task, and a few dedicated writer threads persist them. This way the
+ * parsing of the next translation unit overlaps with the database traffic of
+ * the previous one. A writer thread executes several tasks in one transaction.
+ * The queue is bounded: if the writers can't keep up then enqueue() blocks the
+ * parser threads until there is room again.
+ */
+class DatabaseWriter
+{
+public:
+  typedef std::function<void()> Task;
+
+  /**
+   * @param db_ The database to write.
+   * @param writers_ The number of writer threads. If 0 then enqueue() executes
+   * the tasks synchronously on the calling thread.
+   * @param capacity_ The maximum number of tasks waiting in the queue.
+   */
+  DatabaseWriter(
+    std::shared_ptr<odb::database> db_,
+    std::size_t writers_,
+    std::size_t capacity_);
+
+  DatabaseWriter(const DatabaseWriter&) = delete;
+  DatabaseWriter& operator=(const DatabaseWriter&) = delete;
+
+  /**
+   * The destructor writes the remaining tasks and stops the writer threads.
+   */
+  ~DatabaseWriter();
+
+  /**
+   * This function places a task in the queue. The task is executed in a
+   * database transaction by a writer thread. If the queue is full then the
+   * function blocks until a writer takes a batch of tasks.
+   * @param onCommitted_ Optional function called by the writer thread after
+   * the transaction of the task has been committed. It is not called if the
+   * task fails.
+   */
+  void enqueue(Task task_, Task onCommitted_ = Task());
+
+private:
+  struct Entry
+  {
+    Task task;
+    Task onCommitted;
+  };
+
+  /**
+   * The maximum number of tasks written in one transaction.
+   */
+  static constexpr std::size_t MAX_BATCH_SIZE = 16;
+
+  void writer();
+
+  /**
+   * This function executes the tasks in one transaction. A task which fails
+   * is rolled back by writeTask() without affecting the others. If the whole
+   * transaction fails then every task is retried in its own transaction so
+   * that an error in one translation unit doesn't make the others' results
+   * lost. The onCommitted function of a task is called only if its changes
+   * have been committed. Errors are logged, they never leave the writer
+   * thread.
+   */
+  void write(std::vector<Entry>& batch_);
+
+  /**
+   * This function executes a task in the current transaction between a
+   * savepoint and its release. If the task fails, or it leaves the
+   * transaction aborted, then its changes are rolled back to the savepoint.
+   * @return True if the task has been written.
+   */
+  bool writeTask(Entry& entry_);
+
+  std::shared_ptr<odb::database> _db;
+  const std::size_t _capacity;
+
+  std::deque<Entry> _queue;
+  bool _die;
+
+  std::mutex _lock;
+  std::condition_variable _notEmpty;
+  std::condition_variable _notFull;
+
+  std::vector<std::thread> _threads;
+};
+
+} // parser
+} // cc
+
+#endif // CC_PARSER_DATABASEWRITER_H
@@ -15,6 +15,7 @@
 #include <model/cppdoccomment.h>
 #include <model/cppdoccomment-odb.hxx>
 
+#include "databasewriter.h"
 #include "doccommentformatter.h"
 #include "entitycache.h"
 
@@ -31,11 +32,13 @@ public:
     ParserContext& ctx_,
     clang::ASTContext& astContext_,
     EntityCache& entityCache_,
+    DatabaseWriter& dbWriter_,
     std::unordered_map<const void*, model::CppAstNodeId>& clangToAstNodeId_)
       : _ctx(ctx_),
         _astContext(astContext_),
         _clangSrcMgr(astContext_.getSourceManager()),
         _entityCache(entityCache_),
+        _dbWriter(dbWriter_),
         _clangToAstNodeId(clangToAstNodeId_)
   {
   }
@@ -68,10 +71,13 @@ public:
 
   ~DocCommentCollector()
   {
-    (util::OdbTransaction(_ctx.db))([this]{
-      for (auto cmt : _docComments)
+    _dbWriter.enqueue([
+      db = _ctx.db,
+      docComments = std::move(_docComments)]
+    {
+      for (auto cmt : docComments)
       {
-        _ctx.db->persist(*(cmt.second));
+        db->persist(*(cmt.second));
       }
     });
   }
@@ -84,6 +90,7 @@ private:
   const clang::ASTContext& _astContext;
   const clang::SourceManager& _clangSrcMgr;
   EntityCache& _entityCache;
+  DatabaseWriter& _dbWriter;
   std::unordered_map<const void*, model::CppAstNodeId>& _clangToAstNodeId;
 };
 
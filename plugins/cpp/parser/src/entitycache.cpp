@@ -1,26 +1,222 @@
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include <util/logutil.h>
+
 #include "entitycache.h"
 
+namespace
+{
+
+/**
+ * Layout of the snapshot file: a header followed by header.count records.
+ * The stamp identifies the database state the snapshot was written for.
+ */
+struct SnapshotHeader
+{
+  char magic[4];
+  std::uint32_t version;
+  std::uint64_t count;
+  std::uint64_t stamp;
+};
+
+struct SnapshotRecord
+{
+  std::uint64_t id;
+  std::uint64_t entityHash;
+  std::uint64_t file;
+};
+
+const char SNAPSHOT_MAGIC[4] = {'C', 'C', 'E', 'C'};
+const std::uint32_t SNAPSHOT_VERSION = 2;
+
+}
+
 namespace cc
 {
 namespace parser
 {
 
+EntityCache::Shard& EntityCache::shardOf(const model::CppAstNodeId& id_)
+{
+  return _shards[id_ % NUM_SHARDS];
+}
+
+const EntityCache::Shard& EntityCache::shardOf(
+  const model::CppAstNodeId& id_) const
+{
+  return _shards[id_ % NUM_SHARDS];
+}
+
 bool EntityCache::insert(const model::CppAstNode& node_)
 {
-  std::lock_guard<std::mutex> guard(_cacheMutex);
-  return _entityCache.insert(
-    std::make_pair(node_.id, node_.entityHash)).second;
+  Entry entry{
+    node_.entityHash,
+    node_.location.file ? node_.location.file.object_id() : 0};
+
+  Shard& shard = shardOf(node_.id);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  return shard.entities.insert(std::make_pair(node_.id, entry)).second;
 }
 
 std::uint64_t EntityCache::at(const model::CppAstNodeId& id_) const
 {
-  std::lock_guard<std::mutex> guard(_cacheMutex);
-  return _entityCache.at(id_);
+  const Shard& shard = shardOf(id_);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  return shard.entities.at(id_).entityHash;
+}
+
+std::size_t EntityCache::size() const
+{
+  std::size_t size = 0;
+
+  for (const Shard& shard : _shards)
+  {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    size += shard.entities.size();
+  }
+
+  return size;
 }
 
 void EntityCache::clear()
 {
-  _entityCache.clear();
+  for (Shard& shard : _shards)
+  {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    shard.entities.clear();
+  }
+}
+
+bool EntityCache::loadSnapshot(
+  const std::string& path_,
+  std::uint64_t stamp_,
+  const std::unordered_set<model::FileId>& staleFiles_)
+{
+  int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<std::size_t>(st.st_size) < sizeof(SnapshotHeader))
+  {
+    ::close(fd);
+    return false;
+  }
+
+  std::size_t size = st.st_size;
+  void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (data == MAP_FAILED)
+    return false;
+
+  ::madvise(data, size, MADV_SEQUENTIAL);
+
+  //--- Check the header ---//
+
+  const SnapshotHeader* header = static_cast<const SnapshotHeader*>(data);
+
+  if (std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) ||
+      header->version != SNAPSHOT_VERSION ||
+      (size - sizeof(SnapshotHeader)) / sizeof(SnapshotRecord)
+        != header->count)
+  {
+    LOG(warning) << "Entity cache snapshot is corrupt: " << path_;
+    ::munmap(data, size);
+    return false;
+  }
+
+  if (header->stamp != stamp_)
+  {
+    LOG(warning)
+      << "Entity cache snapshot belongs to another database state: " << path_;
+    ::munmap(data, size);
+    return false;
+  }
+
+  //--- Fill the shards ---//
+
+  const SnapshotRecord* records = reinterpret_cast<const SnapshotRecord*>(
+    static_cast<const char*>(data) + sizeof(SnapshotHeader));
+
+  for (Shard& shard : _shards)
+    shard.entities.reserve(header->count / NUM_SHARDS + 1);
+
+  for (std::uint64_t i = 0; i < header->count; ++i)
+  {
+    const SnapshotRecord& record = records[i];
+
+    if (record.file && staleFiles_.count(record.file))
+      continue;
+
+    Shard& shard = shardOf(record.id);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    shard.entities.emplace(record.id, Entry{record.entityHash, record.file});
+  }
+
+  ::munmap(data, size);
+
+  return true;
+}
+
+bool EntityCache::saveSnapshot(
+  const std::string& path_,
+  std::uint64_t stamp_) const
+{
+  namespace fs = boost::filesystem;
+
+  fs::path path(path_);
+  fs::path tmpPath(path_ + ".tmp");
+
+  boost::system::error_code ec;
+  fs::create_directories(path.parent_path(), ec);
+
+  std::ofstream ofs(tmpPath.native(), std::ios::binary);
+  if (!ofs)
+    return false;
+
+  SnapshotHeader header;
+  std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  header.version = SNAPSHOT_VERSION;
+  header.count = 0;
+  header.stamp = stamp_;
+
+  // The header is rewritten with the final count at the end.
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  for (const Shard& shard : _shards)
+  {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+
+    for (const auto& entity : shard.entities)
+    {
+      SnapshotRecord record{
+        entity.first, entity.second.entityHash, entity.second.file};
+      ofs.write(reinterpret_cast<const char*>(&record), sizeof(record));
+      ++header.count;
+    }
+  }
+
+  ofs.seekp(0);
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  ofs.close();
+  if (!ofs)
+  {
+    fs::remove(tmpPath, ec);
+    return false;
+  }
+
+  // The rename is atomic, so a crash never leaves a truncated snapshot.
+  fs::rename(tmpPath, path, ec);
+  return !ec;
 }
 
 }
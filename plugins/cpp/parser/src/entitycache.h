@@ -1,10 +1,14 @@
 #ifndef CC_PARSER_ENTITYCACHE_H
 #define CC_PARSER_ENTITYCACHE_H
 
+#include <array>
+#include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <mutex>
 
 #include <model/cppastnode.h>
+#include <model/file.h>
 
 namespace cc
 {
@@ -32,14 +36,63 @@ public:
    */
   std::uint64_t at(const model::CppAstNodeId& id_) const;
 
+  /**
+   * Returns the number of elements in the cache.
+   */
+  std::size_t size() const;
+
   /**
    * Removes all elements from the cache.
    */
   void clear();
 
+  /**
+   * This function fills the cache from a snapshot file written by
+   * saveSnapshot(). The nodes located in one of the staleFiles_ are left out.
+   * The snapshot is memory mapped, so loading it is much faster than querying
+   * every model::CppAstNode from the database.
+   * @param stamp_ The stamp of the current database state. The snapshot is
+   * loaded only if it was saved with the same stamp.
+   * @return False if the snapshot doesn't exist, is corrupt or has another
+   * stamp. In this case the cache is left empty.
+   */
+  bool loadSnapshot(
+    const std::string& path_,
+    std::uint64_t stamp_,
+    const std::unordered_set<model::FileId>& staleFiles_);
+
+  /**
+   * This function writes the content of the cache to a snapshot file. The
+   * snapshot is in the native byte order, it is not meant to be portable.
+   * @param stamp_ A value identifying the database state the cache belongs
+   * to. It is also stored in the database by the caller.
+   * @return True on success.
+   */
+  bool saveSnapshot(const std::string& path_, std::uint64_t stamp_) const;
+
 private:
-  std::unordered_map<model::CppAstNodeId, std::uint64_t> _entityCache;
-  mutable std::mutex _cacheMutex;
+  struct Entry
+  {
+    std::uint64_t entityHash;
+    model::FileId file;
+  };
+
+  /**
+   * The cache is split into shards by the node id, each guarded by its own
+   * mutex, so parser threads inserting different nodes rarely contend.
+   */
+  static constexpr std::size_t NUM_SHARDS = 64;
+
+  struct Shard
+  {
+    std::unordered_map<model::CppAstNodeId, Entry> entities;
+    mutable std::mutex mutex;
+  };
+
+  Shard& shardOf(const model::CppAstNodeId& id_);
+  const Shard& shardOf(const model::CppAstNodeId& id_) const;
+
+  std::array<Shard, NUM_SHARDS> _shards;
 };
 
 } // parser
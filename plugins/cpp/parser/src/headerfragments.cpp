@@ -0,0 +1,178 @@
+#include <llvm/ADT/SmallString.h>
+
+#include <parser/sourcemanager.h>
+#include <util/hash.h>
+
+#include "headerfragments.h"
+
+namespace cc
+{
+namespace parser
+{
+
+std::uint64_t HeaderFragmentRegistry::fragment(
+  model::FileId file_,
+  std::uint64_t context_)
+{
+  return util::fnvHash(
+    std::to_string(file_) + ':' + std::to_string(context_));
+}
+
+bool HeaderFragmentRegistry::isIndexed(std::uint64_t fragment_)
+{
+  std::lock_guard<std::mutex> guard(_fragmentsMutex);
+  return _fragments.count(fragment_);
+}
+
+void HeaderFragmentRegistry::markIndexed(
+  const std::vector<std::uint64_t>& fragments_)
+{
+  std::lock_guard<std::mutex> guard(_fragmentsMutex);
+  _fragments.insert(fragments_.begin(), fragments_.end());
+}
+
+void HeaderFragmentRegistry::clear()
+{
+  _fragments.clear();
+}
+
+HeaderFragmentCallback::HeaderFragmentCallback(
+  ParserContext& ctx_,
+  clang::Preprocessor& pp_,
+  HeaderFragmentRegistry& registry_,
+  std::unordered_set<unsigned>& indexedElsewhere_,
+  std::vector<std::uint64_t>& indexedHere_) :
+    _ctx(ctx_),
+    _pp(pp_),
+    _clangSrcMgr(pp_.getSourceManager()),
+    _registry(registry_),
+    _indexedElsewhere(indexedElsewhere_),
+    _indexedHere(indexedHere_),
+    _context(0)
+{
+  // The preprocessor owns this callback, so it outlives the token watcher.
+  _pp.setTokenWatcher([this](const clang::Token& token_) {
+    onToken(token_);
+  });
+}
+
+void HeaderFragmentCallback::FileChanged(
+  clang::SourceLocation loc_,
+  FileChangeReason reason_,
+  clang::SrcMgr::CharacteristicKind,
+  clang::FileID)
+{
+  if (reason_ != EnterFile)
+    return;
+
+  addMainFileTokens();
+
+  clang::FileID fid = _clangSrcMgr.getFileID(loc_);
+  if (fid.isInvalid() || fid == _clangSrcMgr.getMainFileID())
+    return;
+
+  // The predefines buffer has no file entry.
+  const clang::FileEntry* fileEntry = _clangSrcMgr.getFileEntryForID(fid);
+  if (!fileEntry)
+    return;
+
+  model::FilePtr file = _ctx.srcMgr.getFile(fileEntry->getName().str());
+
+  std::uint64_t fragment = HeaderFragmentRegistry::fragment(file->id, _context);
+
+  if (_registry.isIndexed(fragment))
+    _indexedElsewhere.insert(fid.getHashValue());
+  else
+    _indexedHere.push_back(fragment);
+
+  addToContext(std::to_string(file->id));
+}
+
+void HeaderFragmentCallback::MacroDefined(
+  const clang::Token& macroNameTok_,
+  const clang::MacroDirective* md_)
+{
+  if (!isExternalInput(md_->getLocation()))
+    return;
+
+  addMainFileTokens();
+
+  const clang::MacroInfo* mi = md_->getMacroInfo();
+
+  std::string definition = "#define " + _pp.getSpelling(macroNameTok_);
+
+  if (mi->isFunctionLike())
+  {
+    definition += '(';
+    for (const clang::IdentifierInfo* param : mi->params())
+      definition += param->getName().str() + ',';
+    definition += ')';
+  }
+
+  for (const clang::Token& token : mi->tokens())
+    definition += ' ' + _pp.getSpelling(token);
+
+  addToContext(definition);
+}
+
+void HeaderFragmentCallback::MacroUndefined(
+  const clang::Token& macroNameTok_,
+  const clang::MacroDefinition&,
+  const clang::MacroDirective* undef_)
+{
+  if (undef_ && !isExternalInput(undef_->getLocation()))
+    return;
+
+  addMainFileTokens();
+  addToContext("#undef " + _pp.getSpelling(macroNameTok_));
+}
+
+bool HeaderFragmentCallback::isExternalInput(
+  const clang::SourceLocation& loc_) const
+{
+  if (loc_.isInvalid())
+    return true;
+
+  clang::FileID fid = _clangSrcMgr.getFileID(
+    _clangSrcMgr.getExpansionLoc(loc_));
+
+  return fid == _clangSrcMgr.getMainFileID()
+    || !_clangSrcMgr.getFileEntryForID(fid);
+}
+
+void HeaderFragmentCallback::onToken(const clang::Token& token_)
+{
+  if (token_.is(clang::tok::eof) ||
+      token_.getLocation().isInvalid() ||
+      !_clangSrcMgr.isInMainFile(token_.getLocation()))
+    return;
+
+  // Annotation tokens (e.g. the ones of #pragma pack) have no spelling.
+  if (token_.isAnnotation())
+    _mainFileTokens += clang::tok::getTokenName(token_.getKind());
+  else
+  {
+    llvm::SmallString<64> buffer;
+    llvm::StringRef spelling = _pp.getSpelling(token_, buffer);
+    _mainFileTokens.append(spelling.data(), spelling.size());
+  }
+
+  _mainFileTokens += ' ';
+}
+
+void HeaderFragmentCallback::addToContext(const std::string& value_)
+{
+  _context = util::fnvHash(std::to_string(_context) + ':' + value_);
+}
+
+void HeaderFragmentCallback::addMainFileTokens()
+{
+  if (_mainFileTokens.empty())
+    return;
+
+  addToContext(_mainFileTokens);
+  _mainFileTokens.clear();
+}
+
+} // parser
+} // cc
@@ -0,0 +1,140 @@
+#ifndef CC_PARSER_HEADERFRAGMENTS_H
+#define CC_PARSER_HEADERFRAGMENTS_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <clang/Basic/SourceManager.h>
+#include <clang/Lex/PPCallbacks.h>
+#include <clang/Lex/Preprocessor.h>
+
+#include <model/file.h>
+
+#include <parser/parsercontext.h>
+
+namespace cc
+{
+namespace parser
+{
+
+/**
+ * Thread safe registry of the header fragments which are already indexed.
+ *
+ * A header fragment is one entry of a header file during the preprocessing of
+ * a translation unit. Its content is determined by the file and by the
+ * preprocessor context at the point of inclusion (see HeaderFragmentCallback).
+ * A fragment is registered only when the results of a translation unit which
+ * indexed it have been committed to the database. The translation units
+ * entering it afterwards may skip it. Until then every translation unit
+ * entering the fragment indexes it, so a failing translation unit can't make
+ * its functions lost.
+ */
+class HeaderFragmentRegistry
+{
+public:
+  /**
+   * This function returns the identifier of the fragment of the given file in
+   * the given preprocessor context.
+   */
+  static std::uint64_t fragment(model::FileId file_, std::uint64_t context_);
+
+  /**
+   * This function returns true if the fragment has been indexed and
+   * committed by a translation unit.
+   */
+  bool isIndexed(std::uint64_t fragment_);
+
+  /**
+   * This function registers the given fragments as indexed. It has to be
+   * called after the results of their translation unit have been committed.
+   */
+  void markIndexed(const std::vector<std::uint64_t>& fragments_);
+
+  /**
+   * Removes all elements from the registry.
+   */
+  void clear();
+
+private:
+  std::unordered_set<std::uint64_t> _fragments;
+  std::mutex _fragmentsMutex;
+};
+
+/**
+ * This class computes the preprocessor context of each header file entered
+ * during the preprocessing of a translation unit and looks up the fragments
+ * in a HeaderFragmentRegistry. The clang::FileID of the fragments indexed by
+ * another translation unit are collected in a set, the identifiers of the
+ * other fragments are collected in a vector. The latter have to be registered
+ * when the results of this translation unit are committed.
+ *
+ * The context is a rolling hash of the inputs which may influence the meaning
+ * of a header: the macros defined or undefined outside of headers (on the
+ * command line, by the compiler or in the main file), the tokens of the main
+ * file and the sequence of the headers entered before. Two translation units
+ * have the same context at a header entry only if they preprocessed the same
+ * token stream before it.
+ */
+class HeaderFragmentCallback : public clang::PPCallbacks
+{
+public:
+  HeaderFragmentCallback(
+    ParserContext& ctx_,
+    clang::Preprocessor& pp_,
+    HeaderFragmentRegistry& registry_,
+    std::unordered_set<unsigned>& indexedElsewhere_,
+    std::vector<std::uint64_t>& indexedHere_);
+
+  virtual void FileChanged(
+    clang::SourceLocation loc_,
+    FileChangeReason reason_,
+    clang::SrcMgr::CharacteristicKind fileType_,
+    clang::FileID prevFid_) override;
+
+  virtual void MacroDefined(
+    const clang::Token& macroNameTok_,
+    const clang::MacroDirective* md_) override;
+
+  virtual void MacroUndefined(
+    const clang::Token& macroNameTok_,
+    const clang::MacroDefinition& md_,
+    const clang::MacroDirective* undef_) override;
+
+private:
+  /**
+   * This function returns true if the location is not in a header file.
+   */
+  bool isExternalInput(const clang::SourceLocation& loc_) const;
+
+  /**
+   * This function is called for every token returned by the preprocessor.
+   * The tokens of the main file are collected in _mainFileTokens.
+   */
+  void onToken(const clang::Token& token_);
+
+  void addToContext(const std::string& value_);
+
+  /**
+   * This function adds the main file tokens collected since the last call to
+   * the context.
+   */
+  void addMainFileTokens();
+
+  ParserContext& _ctx;
+  clang::Preprocessor& _pp;
+  const clang::SourceManager& _clangSrcMgr;
+  HeaderFragmentRegistry& _registry;
+  std::unordered_set<unsigned>& _indexedElsewhere;
+  std::vector<std::uint64_t>& _indexedHere;
+
+  std::uint64_t _context;
+  std::string _mainFileTokens;
+};
+
+} // parser
+} // cc
+
+#endif // CC_PARSER_HEADERFRAGMENTS_H
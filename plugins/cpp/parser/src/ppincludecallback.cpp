@@ -14,12 +14,14 @@ PPIncludeCallback::PPIncludeCallback(
   ParserContext& ctx_,
   clang::ASTContext& astContext_,
   EntityCache& entityCache_,
+  DatabaseWriter& dbWriter_,
   clang::Preprocessor&) :
     _ctx(ctx_),
     _cppSourceType("CPP"),
     _clangSrcMgr(astContext_.getSourceManager()),
     _fileLocUtil(astContext_.getSourceManager()),
-    _entityCache(entityCache_)
+    _entityCache(entityCache_),
+    _dbWriter(dbWriter_)
 {
 }
 
@@ -27,9 +29,13 @@ PPIncludeCallback::~PPIncludeCallback()
 {
   _ctx.srcMgr.persistFiles();
 
-  (util::OdbTransaction(_ctx.db))([this]{
-    util::persistAll(_astNodes, _ctx.db);
-    util::persistAll(_headerIncs, _ctx.db);
+  _dbWriter.enqueue([
+    db = _ctx.db,
+    astNodes = std::move(_astNodes),
+    headerIncs = std::move(_headerIncs)]() mutable
+  {
+    util::persistAllBulk(astNodes, db);
+    util::persistAll(headerIncs, db);
   });
 }
 
@@ -14,6 +14,7 @@
 
 #include <util/logutil.h>
 
+#include "databasewriter.h"
 #include "entitycache.h"
 
 namespace cc
@@ -28,6 +29,7 @@ public:
     ParserContext& ctx_,
     clang::ASTContext& astContext_,
     EntityCache& entityCache_,
+    DatabaseWriter& dbWriter_,
     clang::Preprocessor& pp_);
 
   ~PPIncludeCallback();
@@ -57,6 +59,7 @@ private:
   const clang::SourceManager& _clangSrcMgr;
   FileLocUtil _fileLocUtil;
   EntityCache& _entityCache;
+  DatabaseWriter& _dbWriter;
 
   std::vector<model::CppAstNodePtr>         _astNodes;
   std::vector<model::CppHeaderInclusionPtr> _headerIncs;
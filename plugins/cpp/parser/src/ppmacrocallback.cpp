@@ -14,13 +14,15 @@ PPMacroCallback::PPMacroCallback(
   ParserContext& ctx_,
   clang::ASTContext& astContext_,
   EntityCache& entityCache_,
+  DatabaseWriter& dbWriter_,
   clang::Preprocessor& pp_) :
     _ctx(ctx_),
     _pp(pp_),
     _cppSourceType("CPP"),
     _clangSrcMgr(astContext_.getSourceManager()),
     _fileLocUtil(astContext_.getSourceManager()),
-    _entityCache(entityCache_)
+    _entityCache(entityCache_),
+    _dbWriter(dbWriter_)
 {
 }
 
@@ -28,10 +30,15 @@ PPMacroCallback::~PPMacroCallback()
 {
   _ctx.srcMgr.persistFiles();
 
-  (util::OdbTransaction(_ctx.db))([this]{
-    util::persistAll(_astNodes, _ctx.db);
-    util::persistAll(_macros, _ctx.db);
-    util::persistAll(_macrosExpansion, _ctx.db);
+  _dbWriter.enqueue([
+    db = _ctx.db,
+    astNodes = std::move(_astNodes),
+    macros = std::move(_macros),
+    macrosExpansion = std::move(_macrosExpansion)]() mutable
+  {
+    util::persistAllBulk(astNodes, db);
+    util::persistAll(macros, db);
+    util::persistAll(macrosExpansion, db);
   });
 }
 
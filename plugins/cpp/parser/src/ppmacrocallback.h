@@ -16,6 +16,7 @@
 
 #include <util/logutil.h>
 
+#include "databasewriter.h"
 #include "entitycache.h"
 
 namespace cc
@@ -30,6 +31,7 @@ public:
     ParserContext& ctx_,
     clang::ASTContext& astContext_,
     EntityCache& entityCache_,
+    DatabaseWriter& dbWriter_,
     clang::Preprocessor& pp_);
 
   ~PPMacroCallback();
@@ -89,6 +91,7 @@ private:
   bool _disabled = false;
 
   EntityCache& _entityCache;
+  DatabaseWriter& _dbWriter;
   std::vector<model::CppAstNodePtr>        _astNodes;
   std::vector<model::CppMacroPtr>          _macros;
   std::vector<model::CppMacroExpansionPtr> _macrosExpansion;
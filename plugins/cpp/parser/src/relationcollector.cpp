@@ -18,8 +18,10 @@ std::mutex RelationCollector::_edgeCacheMutex;
 
 RelationCollector::RelationCollector(
   ParserContext& ctx_,
-  clang::ASTContext& astContext_)
+  clang::ASTContext& astContext_,
+  DatabaseWriter& dbWriter_)
   : _ctx(ctx_),
+    _dbWriter(dbWriter_),
     _fileLocUtil(astContext_.getSourceManager())
 {
   // Fill edge cache on first object initialization
@@ -45,9 +47,13 @@ RelationCollector::~RelationCollector()
 {
   _ctx.srcMgr.persistFiles();
 
-  (util::OdbTransaction(_ctx.db))([this]{
-    util::persistAll(_newEdges, _ctx.db);
-    util::persistAll(_newEdgeAttributes, _ctx.db);
+  _dbWriter.enqueue([
+    db = _ctx.db,
+    newEdges = std::move(_newEdges),
+    newEdgeAttributes = std::move(_newEdgeAttributes)]() mutable
+  {
+    util::persistAllBulk(newEdges, db);
+    util::persistAllBulk(newEdgeAttributes, db);
   });
 }
 
@@ -16,6 +16,8 @@
 
 #include <cppparser/filelocutil.h>
 
+#include "databasewriter.h"
+
 namespace cc
 {
 namespace parser
@@ -26,7 +28,8 @@ class RelationCollector : public clang::RecursiveASTVisitor<RelationCollector>
 public:
   RelationCollector(
     ParserContext& ctx_,
-    clang::ASTContext& astContext_);
+    clang::ASTContext& astContext_,
+    DatabaseWriter& dbWriter_);
 
   ~RelationCollector();
 
@@ -46,6 +49,7 @@ private:
     model::CppEdgeAttributePtr attr_ = nullptr);
 
   ParserContext& _ctx;
+  DatabaseWriter& _dbWriter;
 
   static std::unordered_set<model::CppEdgeId> _edgeCache;
   static std::unordered_set<model::CppEdgeAttributeId> _edgeAttrCache;
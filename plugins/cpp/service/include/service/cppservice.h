@@ -2,11 +2,14 @@
 #define CC_SERVICE_LANGUAGE_CPPSERVICE_H
 
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <unordered_set>
 #include <string>
 
+#include <boost/optional.hpp>
 #include <boost/program_options/variables_map.hpp>
 
 #include <odb/database.hxx>
@@ -29,6 +32,10 @@ namespace service
 namespace language
 {
 
+class AstNodeIndexCache;
+class ReadCache;
+class RelationGraphCache;
+
 class CppServiceHandler : virtual public LanguageServiceIf
 {
   friend class Diagram;
@@ -294,6 +301,16 @@ private:
     const odb::query<model::CppAstNode>& query_
       = odb::query<model::CppAstNode>(true));
 
+  /**
+   * If the references of the given type are the AST nodes of the same entity
+   * as node_ (e.g. usages, definitions) then this function returns the query
+   * selecting them, so they can be filtered and paginated in the database.
+   * Otherwise it returns boost::none.
+   */
+  boost::optional<odb::query<model::CppAstNode>> entityReferenceQuery(
+    const model::CppAstNode& node_,
+    std::int32_t referenceId_);
+
   /**
    * This function returns the model::CppAstNode objects which meet the
    * requirements of the given query in the given file.
@@ -355,6 +372,16 @@ private:
     std::uint64_t to_,
     bool reverse_ = false);
 
+  /**
+   * This function returns the number of model::CppAstNode objects which meet
+   * the requirements of the given query and have one of the given entity
+   * hashes. The hashes are passed in chunks of IN (...) lists.
+   */
+  template <typename Container>
+  std::size_t countByEntityHashes(
+    const Container& entityHashes_,
+    const odb::query<model::CppAstNode>& query_);
+
   /**
    * This function returns meta information of the AST nodes
    * (e.g. public, static, virtual etc.)
@@ -393,6 +420,43 @@ private:
   std::shared_ptr<std::string> _datadir;
   const cc::webserver::ServerContext& _context;
 
+  /**
+   * Number of files whose AST node index is kept in memory for
+   * getAstNodeInfoByPosition().
+   */
+  static constexpr std::size_t AST_NODE_INDEX_CAPACITY = 64;
+
+  std::shared_ptr<AstNodeIndexCache> _astNodeIndex;
+
+  std::shared_ptr<RelationGraphCache> _relationGraphs;
+
+  /**
+   * Memory budget of the AST node and file cache in MiB if it is not given by
+   * the cpp-read-cache-size option.
+   */
+  static constexpr std::size_t DEFAULT_READ_CACHE_SIZE = 256;
+
+  std::shared_ptr<ReadCache> _readCache;
+
+  /**
+   * True if the database has the syntax highlight computed by the parser.
+   * Databases of an older parser have no such table.
+   */
+  const bool _hasSyntaxTokens;
+
+  /**
+   * The position of the last AST node of the recently returned reference
+   * pages: (file, AST node id) by the key of the page. getReferencesPage()
+   * continues from here when the next page is requested, instead of skipping
+   * the preceding references with an OFFSET.
+   */
+  static constexpr std::size_t MAX_PAGE_CURSORS = 1024;
+
+  std::unordered_map<
+    std::string,
+    std::pair<model::FileId, model::CppAstNodeId>> _pageCursors;
+  std::mutex _pageCursorsMutex;
+
   std::string toShortDiagnosticString(const model::CppAstNode& node) const;
 };
 
@@ -0,0 +1,170 @@
+#include <algorithm>
+
+#include <model/cppastnode-odb.hxx>
+
+#include "astnodeindex.h"
+
+namespace cc
+{
+namespace service
+{
+namespace language
+{
+
+FileAstNodeIndex::FileAstNodeIndex(std::vector<model::CppAstNodeSpan> spans_)
+  : _spans(std::move(spans_)), _maxEnd(_spans.size())
+{
+  std::sort(_spans.begin(), _spans.end(),
+    [](const model::CppAstNodeSpan& lhs_, const model::CppAstNodeSpan& rhs_)
+    {
+      return lhs_.range.start < rhs_.range.start;
+    });
+
+  build(0, _spans.size());
+}
+
+model::Position FileAstNodeIndex::build(std::size_t begin_, std::size_t end_)
+{
+  if (begin_ == end_)
+    return model::Position(0, 0);
+
+  std::size_t mid = begin_ + (end_ - begin_) / 2;
+
+  model::Position maxEnd = _spans[mid].range.end;
+  maxEnd = std::max(maxEnd, build(begin_, mid));
+  maxEnd = std::max(maxEnd, build(mid + 1, end_));
+
+  return _maxEnd[mid] = maxEnd;
+}
+
+template <typename Function>
+void FileAstNodeIndex::stab(
+  std::size_t begin_,
+  std::size_t end_,
+  const model::Position& pos_,
+  Function func_) const
+{
+  while (begin_ != end_)
+  {
+    std::size_t mid = begin_ + (end_ - begin_) / 2;
+
+    // No span in this subtree ends after the position.
+    if (!(pos_ < _maxEnd[mid]))
+      return;
+
+    stab(begin_, mid, pos_, func_);
+
+    // The spans from here on start after the position.
+    if (pos_ < _spans[mid].range.start)
+      return;
+
+    if (pos_ < _spans[mid].range.end)
+      func_(_spans[mid]);
+
+    begin_ = mid + 1;
+  }
+}
+
+model::CppAstNodeId FileAstNodeIndex::find(const model::Position& pos_) const
+{
+  model::Range minRange(model::Position(0, 0), model::Position());
+  model::CppAstNodeId min = 0;
+  bool macro = false;
+
+  stab(0, _spans.size(), pos_,
+    [&](const model::CppAstNodeSpan& span_)
+    {
+      if (macro)
+        return;
+
+      // TODO: Remove ugly hack and use CppAstNode::visibleInSourceCode when it
+      // will be available.
+      if (span_.symbolType == model::CppAstNode::SymbolType::Macro)
+      {
+        min = span_.id;
+        macro = true;
+        return;
+      }
+
+      if (span_.visibleInSourceCode && span_.range < minRange)
+      {
+        min = span_.id;
+        minRange = span_.range;
+      }
+    });
+
+  return min;
+}
+
+constexpr std::chrono::seconds AstNodeIndexCache::REVALIDATE_INTERVAL;
+
+AstNodeIndexCache::AstNodeIndexCache(
+  std::shared_ptr<odb::database> db_,
+  std::size_t capacity_)
+    : _db(db_), _capacity(capacity_), _generation(db_, REVALIDATE_INTERVAL)
+{
+}
+
+void AstNodeIndexCache::revalidate()
+{
+  if (_generation.check() != ParseGenerationWatcher::Status::Changed)
+    return;
+
+  std::lock_guard<std::mutex> guard(_mutex);
+
+  _entries.clear();
+  _lru.clear();
+}
+
+std::shared_ptr<const FileAstNodeIndex> AstNodeIndexCache::get(
+  model::FileId file_)
+{
+  revalidate();
+
+  {
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    auto it = _entries.find(file_);
+    if (it != _entries.end())
+    {
+      _lru.splice(_lru.begin(), _lru, it->second.lruPos);
+      return it->second.index;
+    }
+  }
+
+  //--- Build the index ---//
+
+  typedef odb::query<model::CppAstNodeSpan> SpanQuery;
+
+  std::vector<model::CppAstNodeSpan> spans;
+  for (const model::CppAstNodeSpan& span
+    : _db->query<model::CppAstNodeSpan>(SpanQuery::location.file == file_))
+    spans.push_back(span);
+
+  std::shared_ptr<const FileAstNodeIndex> index
+    = std::make_shared<FileAstNodeIndex>(std::move(spans));
+
+  std::lock_guard<std::mutex> guard(_mutex);
+
+  auto it = _entries.find(file_);
+  if (it == _entries.end())
+  {
+    _lru.push_front(file_);
+    it = _entries.emplace(file_, Entry()).first;
+    it->second.lruPos = _lru.begin();
+  }
+
+  it->second.index = index;
+
+  while (_entries.size() > _capacity)
+  {
+    _entries.erase(_lru.back());
+    _lru.pop_back();
+  }
+
+  return index;
+}
+
+} // language
+} // service
+} // cc
@@ -0,0 +1,112 @@
+#ifndef CC_SERVICE_LANGUAGE_ASTNODEINDEX_H
+#define CC_SERVICE_LANGUAGE_ASTNODEINDEX_H
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <odb/database.hxx>
+
+#include <model/cppastnode.h>
+#include <model/file.h>
+#include <model/position.h>
+
+#include "parsegeneration.h"
+
+namespace cc
+{
+namespace service
+{
+namespace language
+{
+
+/**
+ * Interval index of the clickable AST nodes of a single file.
+ *
+ * The spans are sorted by their start position and form an implicit balanced
+ * search tree: the middle element of each subarray is the root of its subtree
+ * and _maxEnd stores the greatest end position in that subtree. A stabbing
+ * query visits only O(log n + k) spans, where k is the number of spans
+ * containing the position.
+ */
+class FileAstNodeIndex
+{
+public:
+  FileAstNodeIndex(std::vector<model::CppAstNodeSpan> spans_);
+
+  /**
+   * This function returns the id of the innermost clickable AST node which
+   * contains the given position, or 0 if there is no such node. The selection
+   * is the same as that of CppServiceHandler::getAstNodeInfoByPosition():
+   * a macro expansion wins, otherwise the smallest visible range.
+   */
+  model::CppAstNodeId find(const model::Position& pos_) const;
+
+private:
+  model::Position build(std::size_t begin_, std::size_t end_);
+
+  template <typename Function>
+  void stab(
+    std::size_t begin_,
+    std::size_t end_,
+    const model::Position& pos_,
+    Function func_) const;
+
+  std::vector<model::CppAstNodeSpan> _spans;
+  std::vector<model::Position> _maxEnd;
+};
+
+/**
+ * Thread safe cache of FileAstNodeIndex objects, built lazily from the
+ * database. Only the least recently used capacity_ files are kept.
+ *
+ * The indices are dropped if the database has been parsed again (see
+ * ParseGenerationWatcher). This is checked at most once in every
+ * REVALIDATE_INTERVAL.
+ */
+class AstNodeIndexCache
+{
+public:
+  AstNodeIndexCache(
+    std::shared_ptr<odb::database> db_,
+    std::size_t capacity_);
+
+  /**
+   * Returns the index of the given file. This function has to be called in a
+   * database transaction.
+   */
+  std::shared_ptr<const FileAstNodeIndex> get(model::FileId file_);
+
+private:
+  static constexpr std::chrono::seconds REVALIDATE_INTERVAL{5};
+
+  struct Entry
+  {
+    std::shared_ptr<const FileAstNodeIndex> index;
+    std::list<model::FileId>::iterator lruPos;
+  };
+
+  /**
+   * This function drops every index if the parse generation of the database
+   * has changed since the last check.
+   */
+  void revalidate();
+
+  std::shared_ptr<odb::database> _db;
+  std::size_t _capacity;
+
+  std::unordered_map<model::FileId, Entry> _entries;
+  std::list<model::FileId> _lru;
+  std::mutex _mutex;
+
+  ParseGenerationWatcher _generation;
+};
+
+} // language
+} // service
+} // cc
+
+#endif // CC_SERVICE_LANGUAGE_ASTNODEINDEX_H
@@ -1,7 +1,8 @@
 #include <algorithm>
-#include <queue>
+#include <chrono>
 #include <regex>
 
+#include <util/dbutil.h>
 #include <util/util.h>
 #include <util/logutil.h>
 
@@ -23,11 +24,16 @@
 #include <model/cppmacroexpansion-odb.hxx>
 #include <model/cppdoccomment.h>
 #include <model/cppdoccomment-odb.hxx>
+#include <model/cppsyntaxtokens.h>
+#include <model/cppsyntaxtokens-odb.hxx>
 
 #include <service/cppservice.h>
 
+#include "astnodeindex.h"
 #include "diagram.h"
 #include "filediagram.h"
+#include "readcache.h"
+#include "relationgraph.h"
 
 namespace
 {
@@ -35,8 +41,6 @@ namespace
   typedef odb::result<cc::model::CppAstNode> AstResult;
   typedef odb::query<cc::model::CppFunction> FuncQuery;
   typedef odb::result<cc::model::CppFunction> FuncResult;
-  typedef odb::query<cc::model::CppRelation> RelQuery;
-  typedef odb::result<cc::model::CppRelation> RelResult;
   typedef odb::query<cc::model::CppVariable> VarQuery;
   typedef odb::result<cc::model::CppVariable> VarResult;
   typedef odb::query<cc::model::CppRecord> TypeQuery;
@@ -55,11 +59,38 @@ namespace
   typedef odb::result<cc::model::CppEnumConstant> EnumConstResult;
   typedef odb::query<cc::model::CppMacroExpansion> MacroExpansionQuery;
   typedef odb::result<cc::model::CppMacroExpansion> MacroExpansionResult;
-  typedef odb::query<cc::model::File> FileQuery;
   typedef odb::result<cc::model::File> FileResult;
   typedef odb::query<cc::model::CppDocComment> DocCommentQuery;
   typedef odb::result<cc::model::CppDocComment> DocCommentResult;
 
+  /**
+   * This struct logs the time elapsed between its construction and
+   * destruction, so that the latency of the service functions can be
+   * compared on the debug log.
+   */
+  struct LatencyLog
+  {
+    LatencyLog(const char* function_, std::size_t size_ = 0)
+      : _function(function_),
+        _size(size_),
+        _start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~LatencyLog()
+    {
+      LOG(debug)
+        << "[cppservice] " << _function << " (" << _size << " item(s)) took "
+        << std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - _start).count()
+        << " us";
+    }
+
+    const char* _function;
+    std::size_t _size;
+    std::chrono::steady_clock::time_point _start;
+  };
+
   /**
    * This struct transforms a model::CppAstNode to an AstNodeInfo Thrift
    * object.
@@ -104,6 +135,32 @@ namespace
     const std::map<cc::model::CppAstNodeId, std::vector<std::string>>& _tags;
     std::shared_ptr<odb::database> _db;
   };
+
+  /**
+   * This function returns true if the database has the table of the
+   * precomputed syntax highlight. The table is missing from the databases
+   * created by an older parser. The lookup is done in its own transaction,
+   * because a failing statement aborts the whole transaction on PostgreSQL.
+   */
+  bool hasSyntaxTokensTable(std::shared_ptr<odb::database> db_)
+  {
+    try
+    {
+      cc::util::OdbTransaction {db_} ([&db_]{
+        db_->find<cc::model::CppSyntaxTokens>(0);
+      });
+    }
+    catch (const odb::exception& ex)
+    {
+      LOG(warning)
+        << "[cppservice] The database has no precomputed syntax highlight, "
+           "it is computed from the AST nodes. Parse the project again to "
+           "speed it up. (" << ex.what() << ")";
+      return false;
+    }
+
+    return true;
+  }
 }
 
 namespace cc
@@ -113,6 +170,10 @@ namespace service
 namespace language
 {
 
+constexpr std::size_t CppServiceHandler::AST_NODE_INDEX_CAPACITY;
+constexpr std::size_t CppServiceHandler::MAX_PAGE_CURSORS;
+constexpr std::size_t CppServiceHandler::DEFAULT_READ_CACHE_SIZE;
+
 CppServiceHandler::CppServiceHandler(
   std::shared_ptr<odb::database> db_,
   std::shared_ptr<std::string> datadir_,
@@ -120,7 +181,15 @@ CppServiceHandler::CppServiceHandler(
     : _db(db_),
       _transaction(db_),
       _datadir(datadir_),
-      _context(context_)
+      _context(context_),
+      _astNodeIndex(std::make_shared<AstNodeIndexCache>(
+        db_, AST_NODE_INDEX_CAPACITY)),
+      _relationGraphs(std::make_shared<RelationGraphCache>(db_)),
+      _readCache(std::make_shared<ReadCache>(db_, 1024 * 1024 *
+        (context_.options.count("cpp-read-cache-size")
+          ? context_.options["cpp-read-cache-size"].as<std::size_t>()
+          : DEFAULT_READ_CACHE_SIZE))),
+      _hasSyntaxTokens(hasSyntaxTokensTable(db_))
 {
 }
 
@@ -146,9 +215,15 @@ void CppServiceHandler::getSourceText(
   return_ = _transaction([this, &astNodeId_](){
     model::CppAstNode astNode = queryCppAstNode(astNodeId_);
 
-    if (astNode.location.file)
+    model::FilePtr file = astNode.location.file
+      ? _readCache->findFile(astNode.location.file.object_id())
+      : nullptr;
+    std::shared_ptr<const std::string> content
+      = file ? _readCache->fileContent(*file) : nullptr;
+
+    if (content)
       return cc::util::textRange(
-        astNode.location.file.load()->content.load()->content,
+        *content,
         astNode.location.range.start.line,
         astNode.location.range.start.column,
         astNode.location.range.end.line,
@@ -225,41 +300,20 @@ void CppServiceHandler::getAstNodeInfoByPosition(
   AstNodeInfo& return_,
   const core::FilePosition& fpos_)
 {
-  _transaction([&, this](){
-    //--- Query nodes at the given position ---//
-
-    AstResult nodes = _db->query<model::CppAstNode>(
-      AstQuery::location.file == std::stoull(fpos_.file) &&
-      // StartPos <= Pos
-      ((AstQuery::location.range.start.line == fpos_.pos.line &&
-        AstQuery::location.range.start.column <= fpos_.pos.column) ||
-       AstQuery::location.range.start.line < fpos_.pos.line) &&
-      // Pos < EndPos
-      ((AstQuery::location.range.end.line == fpos_.pos.line &&
-        AstQuery::location.range.end.column > fpos_.pos.column) ||
-       AstQuery::location.range.end.line > fpos_.pos.line));
+  LatencyLog latency("getAstNodeInfoByPosition");
 
+  _transaction([&, this](){
     //--- Select innermost clickable node ---//
 
-    model::Range minRange(model::Position(0, 0), model::Position());
-    model::CppAstNode min;
+    std::shared_ptr<const FileAstNodeIndex> index
+      = _astNodeIndex->get(std::stoull(fpos_.file));
 
-    for (const model::CppAstNode& node : nodes)
-    {
-      // TODO: Remove ugly hack and use CppAstNode::visibleInSourceCode when it
-      // will be available.
-      if (node.symbolType == model::CppAstNode::SymbolType::Macro)
-      {
-        min = node;
-        break;
-      }
+    model::CppAstNodeId id = index->find(
+      model::Position(fpos_.pos.line, fpos_.pos.column));
 
-      if (node.visibleInSourceCode && node.location.range < minRange)
-      {
-        min = node;
-        minRange = node.location.range;
-      }
-    }
+    model::CppAstNode min;
+    if (id)
+      _readCache->findAstNode(id, min);
 
     return_ = _transaction([this, &min](){
       return CreateAstNodeInfo(getTags({min}))(min);
@@ -420,63 +474,55 @@ std::int32_t CppServiceHandler::getReferenceCount(
 
       case CALLEE:
       {
-        std::int32_t count = 0;
-
         std::set<std::uint64_t> defHashes;
         for (const model::CppAstNode& call : queryCalls(astNodeId_))
-        {
-          model::CppAstNode node = queryCppAstNode(std::to_string(call.id));
-          defHashes.insert(node.entityHash);
-        }
-
-        if (!defHashes.empty())
-          count += _db->query_value<model::CppAstCount>(
-            AstQuery::entityHash.in_range(
-              defHashes.begin(), defHashes.end()) &&
-            AstQuery::astType == model::CppAstNode::AstType::Definition &&
-            AstQuery::location.range.end.line != model::Position::npos).count;
+          defHashes.insert(call.entityHash);
 
-        return count;
+        return countByEntityHashes(defHashes,
+          AstQuery::astType == model::CppAstNode::AstType::Definition &&
+          AstQuery::location.range.end.line != model::Position::npos);
       }
 
       case CALLER:
       {
-        std::vector<AstNodeInfo> references;
-        getReferences(references, astNodeId_, CALLER, {});
-        return references.size();
+        typedef odb::query<model::CppAstCallerCount> CallerQuery;
+
+        return _db->query_value<model::CppAstCallerCount>(
+          CallerQuery::Callee::entityHash == node.entityHash &&
+          CallerQuery::Callee::astType
+            == model::CppAstNode::AstType::Usage &&
+          CallerQuery::Callee::location.range.end.line
+            != model::Position::npos &&
+          CallerQuery::Caller::astType
+            == model::CppAstNode::AstType::Definition &&
+          CallerQuery::Caller::symbolType
+            == model::CppAstNode::SymbolType::Function).count;
       }
 
       case VIRTUAL_CALL:
       {
-        std::int32_t count = queryCppAstNodeCount(astNodeId_,
-          AstQuery::astType == model::CppAstNode::AstType::VirtualCall);
-
-        for (const model::CppAstNode& node : queryOverrides(astNodeId_, true))
-          count += queryCppAstNodeCount(std::to_string(node.id),
-            AstQuery::astType == model::CppAstNode::AstType::VirtualCall);
+        std::unordered_set<std::uint64_t> hashes
+          = transitiveClosureOfRel(
+              model::CppRelation::Kind::Override,
+              node.entityHash,
+              true);
+        hashes.insert(node.entityHash);
 
-        return count;
+        return countByEntityHashes(hashes,
+          AstQuery::astType == model::CppAstNode::AstType::VirtualCall &&
+          AstQuery::location.range.end.line != model::Position::npos);
       }
 
       case FUNC_PTR_CALL:
       {
-        std::int32_t count = 0;
-
         std::unordered_set<std::uint64_t> fptrCallers
           = transitiveClosureOfRel(
               model::CppRelation::Kind::Assign,
               node.entityHash,
               true);
 
-        for (std::uint64_t entityHash : fptrCallers)
-        {
-          AstResult result = _db->query<model::CppAstNode>(
-            AstQuery::entityHash == entityHash &&
-            AstQuery::astType == model::CppAstNode::AstType::Usage);
-          count += result.size();
-        }
-
-        return count;
+        return countByEntityHashes(fptrCallers,
+          AstQuery::astType == model::CppAstNode::AstType::Usage);
       }
 
       case PARAMETER:
@@ -656,6 +702,8 @@ void CppServiceHandler::getReferences(
   const std::int32_t referenceId_,
   const std::vector<std::string>& /* tags_ */)
 {
+  LatencyLog latency("getReferences");
+
   std::map<model::CppAstNodeId, std::vector<std::string>> tags;
   std::vector<model::CppAstNode> nodes;
   model::CppAstNode node;
@@ -1104,23 +1152,145 @@ void CppServiceHandler::getDiagramTypes(
 }
 
 void CppServiceHandler::getReferencesInFile(
-  std::vector<AstNodeInfo>& /* return_ */,
-  const core::AstNodeId& /* astNodeId_ */,
-  const std::int32_t /* referenceId_ */,
-  const core::FileId& /* fileId_ */,
-  const std::vector<std::string>& /* tags_ */)
+  std::vector<AstNodeInfo>& return_,
+  const core::AstNodeId& astNodeId_,
+  const std::int32_t referenceId_,
+  const core::FileId& fileId_,
+  const std::vector<std::string>& tags_)
 {
-  // TODO
+  _transaction([&, this](){
+    model::CppAstNode node = queryCppAstNode(astNodeId_);
+
+    boost::optional<AstQuery> query = entityReferenceQuery(node, referenceId_);
+
+    //--- Filter the references which can't be queried by file ---//
+
+    if (!query)
+    {
+      std::vector<AstNodeInfo> references;
+      getReferences(references, astNodeId_, referenceId_, tags_);
+
+      std::copy_if(
+        std::make_move_iterator(references.begin()),
+        std::make_move_iterator(references.end()),
+        std::back_inserter(return_),
+        [&fileId_](const AstNodeInfo& info_)
+        {
+          return info_.range.file == fileId_;
+        });
+
+      return;
+    }
+
+    //--- Query the references in the file ---//
+
+    std::vector<model::CppAstNode> nodes
+      = queryCppAstNodesInFile(fileId_, *query);
+
+    std::sort(nodes.begin(), nodes.end(), compareByPosition);
+
+    return_.reserve(nodes.size());
+    std::transform(
+      nodes.begin(), nodes.end(),
+      std::back_inserter(return_),
+      CreateAstNodeInfo(getTags(nodes)));
+  });
 }
 
 void CppServiceHandler::getReferencesPage(
-  std::vector<AstNodeInfo>& /* return_ */,
-  const core::AstNodeId& /* astNodeId_ */,
-  const std::int32_t /* referenceId_ */,
-  const std::int32_t /* pageSize_ */,
-  const std::int32_t /* pageNo_ */)
+  std::vector<AstNodeInfo>& return_,
+  const core::AstNodeId& astNodeId_,
+  const std::int32_t referenceId_,
+  const std::int32_t pageSize_,
+  const std::int32_t pageNo_)
 {
-  // TODO
+  if (pageSize_ <= 0 || pageNo_ < 0)
+    return;
+
+  auto pageKey = [&](std::int32_t page_)
+  {
+    return astNodeId_ + ':' + std::to_string(referenceId_) + ':'
+      + std::to_string(pageSize_) + ':' + std::to_string(page_);
+  };
+
+  _transaction([&, this](){
+    model::CppAstNode node = queryCppAstNode(astNodeId_);
+
+    boost::optional<AstQuery> query = entityReferenceQuery(node, referenceId_);
+
+    //--- Slice the references which can't be paginated in the database ---//
+
+    if (!query)
+    {
+      std::vector<AstNodeInfo> references;
+      getReferences(references, astNodeId_, referenceId_, {});
+
+      std::size_t begin = std::min<std::size_t>(
+        references.size(), static_cast<std::size_t>(pageNo_) * pageSize_);
+      std::size_t end = std::min<std::size_t>(
+        references.size(), begin + pageSize_);
+
+      std::move(
+        references.begin() + begin,
+        references.begin() + end,
+        std::back_inserter(return_));
+
+      return;
+    }
+
+    //--- Query the page ordered by file and AST node id ---//
+
+    boost::optional<std::pair<model::FileId, model::CppAstNodeId>> cursor;
+
+    if (pageNo_ > 0)
+    {
+      std::lock_guard<std::mutex> guard(_pageCursorsMutex);
+
+      auto it = _pageCursors.find(pageKey(pageNo_ - 1));
+      if (it != _pageCursors.end())
+        cursor = it->second;
+    }
+
+    AstQuery pageQuery = *query && AstQuery::location.file.is_not_null();
+
+    if (cursor)
+      pageQuery = pageQuery &&
+        (AstQuery::location.file > cursor->first ||
+         (AstQuery::location.file == cursor->first &&
+          AstQuery::id > cursor->second));
+
+    pageQuery = pageQuery
+      + "ORDER BY" + AstQuery::location.file + "," + AstQuery::id
+      + "LIMIT" + AstQuery::_val(pageSize_);
+
+    if (pageNo_ > 0 && !cursor)
+      pageQuery = pageQuery + "OFFSET"
+        + AstQuery::_val(static_cast<std::int64_t>(pageNo_) * pageSize_);
+
+    AstResult result = _db->query<model::CppAstNode>(pageQuery);
+    std::vector<model::CppAstNode> nodes(result.begin(), result.end());
+
+    if (nodes.empty())
+      return;
+
+    //--- Remember where the next page starts ---//
+
+    {
+      std::lock_guard<std::mutex> guard(_pageCursorsMutex);
+
+      if (_pageCursors.size() >= MAX_PAGE_CURSORS)
+        _pageCursors.clear();
+
+      _pageCursors[pageKey(pageNo_)] = std::make_pair(
+        nodes.back().location.file.object_id(), nodes.back().id);
+    }
+
+    return_.reserve(nodes.size());
+    std::transform(
+      nodes.begin(), nodes.end(),
+      std::back_inserter(return_),
+      CreateAstNodeInfo(getTags(nodes)));
+  });
 }
 
 void CppServiceHandler::getFileReferenceTypes(
@@ -1138,6 +1308,8 @@ void CppServiceHandler::getFileReferences(
   const core::FileId& fileId_,
   const std::int32_t referenceId_)
 {
+  LatencyLog latency("getFileReferences");
+
   std::map<model::CppAstNodeId, std::vector<std::string>> tags;
   std::vector<model::CppAstNode> nodes;
 
@@ -1226,15 +1398,62 @@ void CppServiceHandler::getSyntaxHighlight(
 
   _transaction([&, this]() {
 
+    //--- Slice the precomputed token stream ---//
+
+    model::CppSyntaxTokensPtr syntaxTokens;
+    if (_hasSyntaxTokens)
+      syntaxTokens
+        = _db->find<model::CppSyntaxTokens>(std::stoull(range_.file));
+
+    if (syntaxTokens)
+    {
+      const model::CppSyntaxToken* begin
+        = reinterpret_cast<const model::CppSyntaxToken*>(
+            syntaxTokens->tokens.data());
+      const model::CppSyntaxToken* end
+        = begin + syntaxTokens->tokens.size() / sizeof(model::CppSyntaxToken);
+
+      const model::CppSyntaxToken* it = std::lower_bound(begin, end,
+        range_.range.startpos.line,
+        [](const model::CppSyntaxToken& token_, std::int64_t line_)
+        {
+          return token_.line < line_;
+        });
+
+      for (; it != end &&
+             static_cast<std::int64_t>(it->line) < range_.range.endpos.line;
+           ++it)
+      {
+        SyntaxHighlight syntax;
+        syntax.range.startpos.line = it->line;
+        syntax.range.startpos.column = it->column;
+        syntax.range.endpos.line = it->line;
+        syntax.range.endpos.column = it->column + it->length;
+
+        std::string symbolClass = "cm-" + model::symbolTypeToString(
+          static_cast<model::CppAstNode::SymbolType>(it->symbolType));
+        syntax.className = symbolClass + " " + symbolClass + "-" +
+          model::astTypeToString(
+            static_cast<model::CppAstNode::AstType>(it->astType));
+
+        return_.push_back(std::move(syntax));
+      }
+
+      return;
+    }
+
+    // The database was created by a parser which didn't compute the tokens.
+
     //--- Load the file content and break it into lines ---//
 
-    model::FilePtr file = _db->query_one<model::File>(
-      FileQuery::id == std::stoull(range_.file));
+    model::FilePtr file = _readCache->findFile(std::stoull(range_.file));
+    std::shared_ptr<const std::string> fileContent
+      = file ? _readCache->fileContent(*file) : nullptr;
 
-    if (!file || !file->content.load())
+    if (!fileContent)
       return;
 
-    std::istringstream s(file->content->content);
+    std::istringstream s(*fileContent);
     std::string line;
     while (std::getline(s, line))
       content.push_back(line);
@@ -1352,8 +1571,7 @@ void CppServiceHandler::getFileDiagramTypes(
   const core::FileId& fileId_)
 {
   model::FilePtr file = _transaction([&, this](){
-    return _db->query_one<model::File>(
-      FileQuery::id == std::stoull(fileId_));
+    return _readCache->findFile(std::stoull(fileId_));
   });
 
   if (file)
@@ -1476,7 +1694,7 @@ model::CppAstNode CppServiceHandler::queryCppAstNode(
   return _transaction([&, this](){
     model::CppAstNode node;
 
-    if (!_db->find(std::stoull(astNodeId_), node))
+    if (!_readCache->findAstNode(std::stoull(astNodeId_), node))
     {
       core::InvalidId ex;
       ex.__set_msg("Invalid CppAstNode ID");
@@ -1502,6 +1720,50 @@ std::vector<model::CppAstNode> CppServiceHandler::queryCppAstNodes(
   return std::vector<model::CppAstNode>(result.begin(), result.end());
 }
 
+boost::optional<odb::query<model::CppAstNode>>
+CppServiceHandler::entityReferenceQuery(
+  const model::CppAstNode& node_,
+  std::int32_t referenceId_)
+{
+  AstQuery query =
+    AstQuery::entityHash == node_.entityHash &&
+    AstQuery::location.range.end.line != model::Position::npos;
+
+  switch (referenceId_)
+  {
+    case DEFINITION:
+      return query &&
+        AstQuery::astType == model::CppAstNode::AstType::Definition;
+
+    case DECLARATION:
+      return query &&
+        AstQuery::astType == model::CppAstNode::AstType::Declaration &&
+        AstQuery::visibleInSourceCode == true;
+
+    case USAGE:
+      return query;
+
+    case CALLS_OF_THIS:
+      return query &&
+        AstQuery::astType == model::CppAstNode::AstType::Usage;
+
+    case READ:
+      return query &&
+        AstQuery::astType == model::CppAstNode::AstType::Read;
+
+    case WRITE:
+      return query &&
+        AstQuery::astType == model::CppAstNode::AstType::Write;
+
+    case UNDEFINITION:
+      return query &&
+        AstQuery::astType == model::CppAstNode::AstType::UnDefinition;
+
+    default:
+      return boost::none;
+  }
+}
+
 std::vector<model::CppAstNode> CppServiceHandler::queryCppAstNodesInFile(
   const core::FileId& fileId_,
   const odb::query<model::CppAstNode>& query_)
@@ -1523,9 +1785,21 @@ std::uint32_t CppServiceHandler::queryCppAstNodeCountInFile(
 std::vector<model::CppAstNode> CppServiceHandler::queryDefinitions(
   const core::AstNodeId& astNodeId_)
 {
-  return queryCppAstNodes(
-    astNodeId_,
-    AstQuery::astType == model::CppAstNode::AstType::Definition);
+  model::CppAstNode node = queryCppAstNode(astNodeId_);
+
+  // This is the most frequent query of the service (jump to definition, call
+  // hierarchy, info tree), so its statement is prepared once per connection.
+  AstResult result = util::executePreparedQuery<model::CppAstNode>(
+    *_db, "cpp-definitions", node.entityHash,
+    [](const std::uint64_t& entityHash_)
+    {
+      return
+        AstQuery::entityHash == AstQuery::_ref(entityHash_) &&
+        AstQuery::location.range.end.line != model::Position::npos &&
+        AstQuery::astType == model::CppAstNode::AstType::Definition;
+    });
+
+  return std::vector<model::CppAstNode>(result.begin(), result.end());
 }
 
 odb::query<model::CppAstNode> CppServiceHandler::astCallsQuery(
@@ -1598,120 +1872,136 @@ CppServiceHandler::transitiveClosureOfRel(
   std::uint64_t to_,
   bool reverse_)
 {
-  std::unordered_set<std::uint64_t> ret;
+  return _transaction([&, this](){
+    return _relationGraphs->get(kind_)->closure(to_, reverse_);
+  });
+}
 
-  std::queue<std::uint64_t> q;
-  q.push(to_);
+std::map<model::CppAstNodeId, std::vector<std::string>>
+CppServiceHandler::getTags(const std::vector<model::CppAstNode>& nodes_)
+{
+  LatencyLog latency("getTags", nodes_.size());
 
-  while (!q.empty())
-  {
-    std::uint64_t current = q.front();
-    q.pop();
+  std::map<model::CppAstNodeId, std::vector<std::string>> tags;
 
-    RelResult result = _db->query<model::CppRelation>(
-      (reverse_ ? RelQuery::lhs : RelQuery::rhs) == current &&
-      RelQuery::kind == kind_);
+  //--- Collect the nodes which may have tags ---//
 
-    for (const model::CppRelation relation : result)
-    {
-      std::uint64_t otherSide = reverse_ ? relation.rhs : relation.lhs;
+  std::vector<const model::CppAstNode*> nodes;
+  std::set<std::uint64_t> entityHashes;
 
-      if (ret.find(otherSide) == ret.end())
-      {
-        ret.insert(otherSide);
-        q.push(otherSide);
-      }
+  for (const model::CppAstNode& node : nodes_)
+    if (node.symbolType == model::CppAstNode::SymbolType::Function ||
+        node.symbolType == model::CppAstNode::SymbolType::Variable)
+    {
+      nodes.push_back(&node);
+      entityHashes.insert(node.entityHash);
     }
-  }
 
-  return ret;
-}
+  if (nodes.empty())
+    return tags;
 
-std::map<model::CppAstNodeId, std::vector<std::string>>
-CppServiceHandler::getTags(const std::vector<model::CppAstNode>& nodes_)
-{
-  std::map<model::CppAstNodeId, std::vector<std::string>> tags;
+  //--- Definitions ---//
 
-  for (const model::CppAstNode& node : nodes_)
+  std::unordered_map<std::uint64_t, model::CppAstNodeId> definitions;
+
+  util::forEachChunk(entityHashes, [&, this](auto begin_, auto end_)
   {
-    std::vector<cc::model::CppAstNode> defs
-      = queryDefinitions(std::to_string(node.id));
+    for (const model::CppAstNode& def : _db->query<model::CppAstNode>(
+      AstQuery::entityHash.in_range(begin_, end_) &&
+      AstQuery::astType == model::CppAstNode::AstType::Definition &&
+      AstQuery::location.range.end.line != model::Position::npos))
+      definitions.emplace(def.entityHash, def.id);
+  });
 
-    const model::CppAstNode& defNode = defs.empty() ? node : defs.front();
+  //--- Member types of the nodes and their definitions ---//
 
-    switch (node.symbolType)
-    {
-      case model::CppAstNode::SymbolType::Function:
-      {
-        for (const model::CppMemberType& mem : _db->query<model::CppMemberType>(
-          (MemTypeQuery::memberAstNode == defNode.id ||
-           MemTypeQuery::memberAstNode == node.id) &&
-          MemTypeQuery::kind == model::CppMemberType::Kind::Method))
-        {
-          //--- Visibility Tag---//
+  std::set<model::CppAstNodeId> memberIds;
+  for (const model::CppAstNode* node : nodes)
+  {
+    memberIds.insert(node->id);
 
-          std::string visibility
-            = cc::model::visibilityToString(mem.visibility);
+    auto it = definitions.find(node->entityHash);
+    if (it != definitions.end())
+      memberIds.insert(it->second);
+  }
 
-          if (!visibility.empty())
-            tags[node.id].push_back(visibility);
-        }
+  std::unordered_multimap<model::CppAstNodeId, model::CppMemberType> members;
 
-        //--- Other Tags ---//
+  util::forEachChunk(memberIds, [&, this](auto begin_, auto end_)
+  {
+    for (const model::CppMemberType& mem : _db->query<model::CppMemberType>(
+      MemTypeQuery::memberAstNode.in_range(begin_, end_)))
+      members.emplace(mem.memberAstNode.object_id(), mem);
+  });
 
-        FuncResult funcNodes = _db->query<cc::model::CppFunction>(
-          FuncQuery::entityHash == defNode.entityHash);
-        if (!funcNodes.empty())
-        {
-          const model::CppFunction& funcNode = *funcNodes.begin();
+  //--- Functions and variables ---//
 
-          for (const model::Tag& tag : funcNode.tags)
-            tags[node.id].push_back(model::tagToString(tag));
-        }
-        else
-          LOG(warning)
-            << "Unexpected empty result when querying tags "
-               "of C++ function: "
-            << toShortDiagnosticString(node);
+  std::unordered_map<std::uint64_t, std::set<model::Tag>> functionTags;
+  std::unordered_map<std::uint64_t, std::set<model::Tag>> variableTags;
 
-        break;
-      }
+  util::forEachChunk(entityHashes, [&, this](auto begin_, auto end_)
+  {
+    for (const model::CppFunction& func : _db->query<model::CppFunction>(
+      FuncQuery::entityHash.in_range(begin_, end_)))
+      functionTags.emplace(func.entityHash, func.tags);
 
-      case model::CppAstNode::SymbolType::Variable:
-      {
-        for (const model::CppMemberType& mem : _db->query<model::CppMemberType>(
-          (MemTypeQuery::memberAstNode == defNode.id ||
-           MemTypeQuery::memberAstNode == node.id) &&
-          MemTypeQuery::kind == model::CppMemberType::Kind::Field))
-        {
-          //--- Visibility Tag---//
+    for (const model::CppVariable& var : _db->query<model::CppVariable>(
+      VarQuery::entityHash.in_range(begin_, end_)))
+      variableTags.emplace(var.entityHash, var.tags);
+  });
 
-          std::string visibility = model::visibilityToString(mem.visibility);
+  //--- Assemble the tags ---//
 
-          if (!visibility.empty())
-            tags[node.id].push_back(visibility);
-        }
+  for (const model::CppAstNode* node : nodes)
+  {
+    bool isFunction
+      = node->symbolType == model::CppAstNode::SymbolType::Function;
 
-        //--- Global Tag ---//
+    model::CppMemberType::Kind kind = isFunction
+      ? model::CppMemberType::Kind::Method
+      : model::CppMemberType::Kind::Field;
 
-        VarResult varNodes = _db->query<cc::model::CppVariable>(
-          VarQuery::entityHash == defNode.entityHash);
-        if (!varNodes.empty())
-        {
-          const model::CppVariable& varNode = *varNodes.begin();
+    auto defIt = definitions.find(node->entityHash);
+    model::CppAstNodeId defId
+      = defIt == definitions.end() ? node->id : defIt->second;
 
-          for (const model::Tag& tag : varNode.tags)
-            tags[node.id].push_back(model::tagToString(tag));
-        }
-        else
-          LOG(warning)
-            << "Unexpected empty result when querying tags "
-               "of C++ variable: "
-            << toShortDiagnosticString(node);
+    //--- Visibility Tag ---//
 
-        break;
+    auto addVisibility = [&](model::CppAstNodeId id_)
+    {
+      auto range = members.equal_range(id_);
+      for (auto it = range.first; it != range.second; ++it)
+      {
+        if (it->second.kind != kind)
+          continue;
+
+        std::string visibility
+          = model::visibilityToString(it->second.visibility);
+
+        if (!visibility.empty())
+          tags[node->id].push_back(visibility);
       }
+    };
+
+    addVisibility(defId);
+    if (defId != node->id)
+      addVisibility(node->id);
+
+    //--- Other Tags ---//
+
+    const auto& entityTags = isFunction ? functionTags : variableTags;
+
+    auto tagIt = entityTags.find(node->entityHash);
+    if (tagIt != entityTags.end())
+    {
+      for (const model::Tag& tag : tagIt->second)
+        tags[node->id].push_back(model::tagToString(tag));
     }
+    else
+      LOG(warning)
+        << "Unexpected empty result when querying tags of C++ "
+        << (isFunction ? "function" : "variable") << ": "
+        << toShortDiagnosticString(*node);
   }
 
   return tags;
@@ -1731,6 +2021,22 @@ std::size_t CppServiceHandler::queryCppAstNodeCount(
   return q.count;
 }
 
+template <typename Container>
+std::size_t CppServiceHandler::countByEntityHashes(
+  const Container& entityHashes_,
+  const AstQuery& query_)
+{
+  std::size_t count = 0;
+
+  util::forEachChunk(entityHashes_, [&, this](auto begin_, auto end_)
+  {
+    count += _db->query_value<model::CppAstCount>(
+      AstQuery::entityHash.in_range(begin_, end_) && query_).count;
+  });
+
+  return count;
+}
+
 std::size_t CppServiceHandler::queryOverridesCount(
   const core::AstNodeId& astNodeId_,
   bool reverse_)
@@ -0,0 +1,52 @@
+#include <model/statistics.h>
+#include <model/statistics-odb.hxx>
+
+#include "parsegeneration.h"
+
+namespace cc
+{
+namespace service
+{
+namespace language
+{
+
+ParseGenerationWatcher::ParseGenerationWatcher(
+  std::shared_ptr<odb::database> db_,
+  std::chrono::steady_clock::duration interval_)
+    : _db(db_), _interval(interval_), _initialized(false), _generation(0)
+{
+}
+
+ParseGenerationWatcher::Status ParseGenerationWatcher::check()
+{
+  typedef odb::query<model::Statistics> StatQuery;
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+  {
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    if (_initialized && now - _validated < _interval)
+      return Status::NotChecked;
+
+    _validated = now;
+  }
+
+  model::StatisticsPtr stat = _db->query_one<model::Statistics>(
+    StatQuery::group == "Parser" && StatQuery::key == "Generation");
+
+  int generation = stat ? stat->value : 0;
+
+  std::lock_guard<std::mutex> guard(_mutex);
+
+  bool changed = _initialized && generation != _generation;
+
+  _generation = generation;
+  _initialized = true;
+
+  return changed ? Status::Changed : Status::Unchanged;
+}
+
+} // language
+} // service
+} // cc
@@ -0,0 +1,59 @@
+#ifndef CC_SERVICE_LANGUAGE_PARSEGENERATION_H
+#define CC_SERVICE_LANGUAGE_PARSEGENERATION_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+#include <odb/database.hxx>
+
+namespace cc
+{
+namespace service
+{
+namespace language
+{
+
+/**
+ * The parser increments a generation stamp in the statistics table at the end
+ * of every run. This class watches that stamp for the caches of the service,
+ * which are valid until the database is parsed again. The stamp is queried at
+ * most once in every interval given to the constructor.
+ */
+class ParseGenerationWatcher
+{
+public:
+  enum class Status
+  {
+    NotChecked, /*!< The interval hasn't passed since the previous query. */
+    Unchanged,  /*!< The generation is the same as at the previous query. */
+    Changed     /*!< The database has been parsed again. */
+  };
+
+  ParseGenerationWatcher(
+    std::shared_ptr<odb::database> db_,
+    std::chrono::steady_clock::duration interval_);
+
+  /**
+   * This function queries the parse generation if the interval has passed
+   * since the previous query. The first query never reports a change. Only
+   * one of the concurrent callers gets Status::Changed for a change. This
+   * function has to be called in a database transaction.
+   */
+  Status check();
+
+private:
+  std::shared_ptr<odb::database> _db;
+  const std::chrono::steady_clock::duration _interval;
+
+  std::mutex _mutex;
+  bool _initialized;
+  int _generation;
+  std::chrono::steady_clock::time_point _validated;
+};
+
+} // language
+} // service
+} // cc
+
+#endif // CC_SERVICE_LANGUAGE_PARSEGENERATION_H
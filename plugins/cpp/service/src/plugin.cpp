@@ -8,7 +8,15 @@ extern "C"
 {
   boost::program_options::options_description getOptions()
   {
+    namespace po = boost::program_options;
+
     boost::program_options::options_description description("C++ Plugin");
+
+    description.add_options()
+      ("cpp-read-cache-size", po::value<std::size_t>()->default_value(256),
+       "The memory budget in MiB of the AST nodes, files and file contents "
+       "which are kept in memory by the C++ service.");
+
     return description;
   }
 
@@ -0,0 +1,143 @@
+#include <model/cppastnode-odb.hxx>
+#include <model/file-odb.hxx>
+#include <model/filecontent.h>
+#include <model/filecontent-odb.hxx>
+
+#include <util/logutil.h>
+
+#include "readcache.h"
+
+namespace
+{
+  /**
+   * Fixed overhead of a cache entry: the list and hash table nodes.
+   */
+  constexpr std::size_t ENTRY_OVERHEAD = 64;
+
+  template <typename Stat>
+  void logStatistics(const char* name_, const Stat& stat_)
+  {
+    LOG(debug)
+      << "[cppservice] " << name_ << " cache: "
+      << stat_.hits << " hit(s), " << stat_.misses << " miss(es), "
+      << stat_.evictions << " eviction(s), " << stat_.entries
+      << " entries in " << stat_.bytes << " bytes";
+  }
+}
+
+namespace cc
+{
+namespace service
+{
+namespace language
+{
+
+constexpr std::chrono::seconds ReadCache::REVALIDATE_INTERVAL;
+
+ReadCache::ReadCache(
+  std::shared_ptr<odb::database> db_,
+  std::size_t capacityBytes_)
+    : _db(db_),
+      _astNodes(capacityBytes_ / 4, [](const model::CppAstNode& node_) {
+        return ENTRY_OVERHEAD + sizeof(node_) + node_.astValue.capacity();
+      }),
+      _files(capacityBytes_ / 8, [](
+        const std::shared_ptr<const model::File>& file_) {
+        return ENTRY_OVERHEAD + sizeof(model::File) + file_->type.capacity()
+          + file_->path.capacity() + file_->filename.capacity();
+      }),
+      _contents(capacityBytes_ - capacityBytes_ / 4 - capacityBytes_ / 8, [](
+        const std::shared_ptr<const std::string>& content_) {
+        return ENTRY_OVERHEAD + sizeof(std::string) + content_->capacity();
+      }),
+      _generation(db_, REVALIDATE_INTERVAL)
+{
+}
+
+bool ReadCache::findAstNode(model::CppAstNodeId id_, model::CppAstNode& node_)
+{
+  revalidate();
+
+  if (_astNodes.get(id_, node_))
+    return true;
+
+  if (!_db->find(id_, node_))
+    return false;
+
+  _astNodes.put(id_, node_);
+  return true;
+}
+
+model::FilePtr ReadCache::findFile(model::FileId id_)
+{
+  revalidate();
+
+  std::shared_ptr<const model::File> file;
+
+  if (!_files.get(id_, file))
+  {
+    file = _db->find<model::File>(id_);
+
+    if (!file)
+      return nullptr;
+
+    _files.put(id_, file);
+  }
+
+  // The lazy pointers of the cached object must not be loaded, otherwise it
+  // would be modified by several threads.
+  return std::make_shared<model::File>(*file);
+}
+
+std::shared_ptr<const std::string> ReadCache::fileContent(
+  const model::File& file_)
+{
+  if (!file_.content)
+    return nullptr;
+
+  revalidate();
+
+  std::string hash = file_.content.object_id();
+  std::shared_ptr<const std::string> content;
+
+  if (_contents.get(hash, content))
+    return content;
+
+  model::FileContentPtr fileContent = _db->find<model::FileContent>(hash);
+
+  if (!fileContent)
+    return nullptr;
+
+  content = std::make_shared<const std::string>(
+    std::move(fileContent->content));
+
+  _contents.put(hash, content);
+  return content;
+}
+
+void ReadCache::revalidate()
+{
+  ParseGenerationWatcher::Status status = _generation.check();
+
+  if (status == ParseGenerationWatcher::Status::NotChecked)
+    return;
+
+  if (status == ParseGenerationWatcher::Status::Changed)
+  {
+    LOG(info)
+      << "[cppservice] The database has been parsed again, dropping the "
+         "read cache.";
+
+    _astNodes.clear();
+    _files.clear();
+    _contents.clear();
+  }
+
+  logStatistics("AST node", _astNodes.statistics());
+  logStatistics("File", _files.statistics());
+  logStatistics("File content", _contents.statistics());
+}
+
+} // language
+} // service
+} // cc
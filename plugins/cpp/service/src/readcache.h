@@ -0,0 +1,75 @@
+#ifndef CC_SERVICE_LANGUAGE_READCACHE_H
+#define CC_SERVICE_LANGUAGE_READCACHE_H
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include <odb/database.hxx>
+
+#include <model/cppastnode.h>
+#include <model/file.h>
+
+#include <util/lrucache.h>
+
+#include "parsegeneration.h"
+
+namespace cc
+{
+namespace service
+{
+namespace language
+{
+
+/**
+ * Memory budgeted cache of the objects which are loaded by their id on every
+ * navigation step: model::CppAstNode, model::File and the content of files.
+ * The memory budget is split between the three kinds of objects. The
+ * functions of this class have to be called in a database transaction.
+ *
+ * The cached objects are valid until the parser runs again: the cache is
+ * dropped when the parse generation changes (see ParseGenerationWatcher). It
+ * is checked at most once in every REVALIDATE_INTERVAL.
+ */
+class ReadCache
+{
+public:
+  ReadCache(std::shared_ptr<odb::database> db_, std::size_t capacityBytes_);
+
+  /**
+   * This function looks up the AST node of the given id.
+   * @return False if there is no such AST node.
+   */
+  bool findAstNode(model::CppAstNodeId id_, model::CppAstNode& node_);
+
+  /**
+   * This function returns the file of the given id or nullptr if there is no
+   * such file. The returned object is a private copy of the caller.
+   */
+  model::FilePtr findFile(model::FileId id_);
+
+  /**
+   * This function returns the content of the given file or nullptr if the
+   * file has no content.
+   */
+  std::shared_ptr<const std::string> fileContent(const model::File& file_);
+
+private:
+  static constexpr std::chrono::seconds REVALIDATE_INTERVAL{1};
+
+  void revalidate();
+
+  std::shared_ptr<odb::database> _db;
+
+  util::LruCache<model::CppAstNodeId, model::CppAstNode> _astNodes;
+  util::LruCache<model::FileId, std::shared_ptr<const model::File>> _files;
+  util::LruCache<std::string, std::shared_ptr<const std::string>> _contents;
+
+  ParseGenerationWatcher _generation;
+};
+
+} // language
+} // service
+} // cc
+
+#endif // CC_SERVICE_LANGUAGE_READCACHE_H
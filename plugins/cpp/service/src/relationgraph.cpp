@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <queue>
+
+#include <model/cpprelation-odb.hxx>
+
+#include "relationgraph.h"
+
+namespace cc
+{
+namespace service
+{
+namespace language
+{
+
+RelationGraph::RelationGraph(
+  const std::vector<std::pair<std::uint64_t, std::uint64_t>>& edges_)
+{
+  //--- Number the vertices ---//
+
+  _vertices.reserve(2 * edges_.size());
+  for (const auto& edge : edges_)
+  {
+    _vertices.push_back(edge.first);
+    _vertices.push_back(edge.second);
+  }
+
+  std::sort(_vertices.begin(), _vertices.end());
+  _vertices.erase(
+    std::unique(_vertices.begin(), _vertices.end()), _vertices.end());
+  _vertices.shrink_to_fit();
+
+  auto vertex = [this](std::uint64_t hash_)
+  {
+    return static_cast<std::uint32_t>(
+      std::lower_bound(_vertices.begin(), _vertices.end(), hash_)
+        - _vertices.begin());
+  };
+
+  //--- Build the adjacency in both directions ---//
+
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> edges;
+  edges.reserve(edges_.size());
+
+  for (const auto& edge : edges_)
+    edges.emplace_back(vertex(edge.first), vertex(edge.second));
+
+  _lhsToRhs = buildCsr(_vertices.size(), edges);
+
+  for (auto& edge : edges)
+    std::swap(edge.first, edge.second);
+
+  _rhsToLhs = buildCsr(_vertices.size(), edges);
+}
+
+RelationGraph::Csr RelationGraph::buildCsr(
+  std::size_t vertices_,
+  std::vector<std::pair<std::uint32_t, std::uint32_t>>& edges_)
+{
+  Csr csr;
+
+  std::sort(edges_.begin(), edges_.end());
+  edges_.erase(std::unique(edges_.begin(), edges_.end()), edges_.end());
+
+  csr.offsets.assign(vertices_ + 1, 0);
+  csr.targets.reserve(edges_.size());
+
+  for (const auto& edge : edges_)
+  {
+    ++csr.offsets[edge.first + 1];
+    csr.targets.push_back(edge.second);
+  }
+
+  for (std::size_t i = 0; i < vertices_; ++i)
+    csr.offsets[i + 1] += csr.offsets[i];
+
+  return csr;
+}
+
+std::unordered_set<std::uint64_t> RelationGraph::closure(
+  std::uint64_t from_,
+  bool reverse_) const
+{
+  std::unordered_set<std::uint64_t> ret;
+
+  auto it = std::lower_bound(_vertices.begin(), _vertices.end(), from_);
+  if (it == _vertices.end() || *it != from_)
+    return ret;
+
+  const Csr& csr = reverse_ ? _lhsToRhs : _rhsToLhs;
+
+  std::vector<bool> visited(_vertices.size());
+  std::queue<std::uint32_t> q;
+  q.push(it - _vertices.begin());
+
+  while (!q.empty())
+  {
+    std::uint32_t current = q.front();
+    q.pop();
+
+    for (std::uint32_t i = csr.offsets[current];
+         i < csr.offsets[current + 1];
+         ++i)
+    {
+      std::uint32_t otherSide = csr.targets[i];
+
+      if (!visited[otherSide])
+      {
+        visited[otherSide] = true;
+        ret.insert(_vertices[otherSide]);
+        q.push(otherSide);
+      }
+    }
+  }
+
+  return ret;
+}
+
+constexpr std::chrono::seconds RelationGraphCache::REVALIDATE_INTERVAL;
+
+RelationGraphCache::RelationGraphCache(std::shared_ptr<odb::database> db_)
+  : _db(db_), _generation(db_, REVALIDATE_INTERVAL)
+{
+}
+
+void RelationGraphCache::revalidate()
+{
+  if (_generation.check() != ParseGenerationWatcher::Status::Changed)
+    return;
+
+  std::lock_guard<std::mutex> guard(_mutex);
+  _graphs.clear();
+}
+
+std::shared_ptr<const RelationGraph> RelationGraphCache::get(
+  model::CppRelation::Kind kind_)
+{
+  typedef odb::query<model::CppRelation> RelQuery;
+
+  revalidate();
+
+  {
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    auto it = _graphs.find(kind_);
+    if (it != _graphs.end())
+      return it->second;
+  }
+
+  //--- Load the relations ---//
+
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> edges;
+
+  for (const model::CppRelation& relation
+    : _db->query<model::CppRelation>(RelQuery::kind == kind_))
+    edges.emplace_back(relation.lhs, relation.rhs);
+
+  std::shared_ptr<const RelationGraph> graph
+    = std::make_shared<RelationGraph>(edges);
+
+  std::lock_guard<std::mutex> guard(_mutex);
+
+  _graphs[kind_] = graph;
+
+  return graph;
+}
+
+} // language
+} // service
+} // cc
@@ -0,0 +1,108 @@
+#ifndef CC_SERVICE_LANGUAGE_RELATIONGRAPH_H
+#define CC_SERVICE_LANGUAGE_RELATIONGRAPH_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <odb/database.hxx>
+
+#include <model/cpprelation.h>
+
+#include "parsegeneration.h"
+
+namespace cc
+{
+namespace service
+{
+namespace language
+{
+
+/**
+ * In-memory graph of the model::CppRelation edges of one kind. The vertices
+ * are the entity hashes, the edges point from lhs to rhs. Both the forward
+ * and the backward adjacency are stored in compressed sparse row form.
+ */
+class RelationGraph
+{
+public:
+  RelationGraph(const std::vector<std::pair<std::uint64_t, std::uint64_t>>&
+    edges_);
+
+  /**
+   * This function returns the entity hashes reachable from the given one. If
+   * reverse_ is true then the edges are followed from lhs to rhs, otherwise
+   * from rhs to lhs. The start vertex is in the result only if it is on a
+   * cycle.
+   */
+  std::unordered_set<std::uint64_t> closure(
+    std::uint64_t from_,
+    bool reverse_) const;
+
+private:
+  struct Csr
+  {
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint32_t> targets;
+  };
+
+  static Csr buildCsr(
+    std::size_t vertices_,
+    std::vector<std::pair<std::uint32_t, std::uint32_t>>& edges_);
+
+  /**
+   * Sorted entity hashes, the index of a hash is its vertex number.
+   */
+  std::vector<std::uint64_t> _vertices;
+
+  Csr _lhsToRhs;
+  Csr _rhsToLhs;
+};
+
+/**
+ * Thread safe cache of the RelationGraph of each relation kind. A graph is
+ * loaded from the database with a single query when it is first used. The
+ * graphs are dropped if the database has been parsed again (see
+ * ParseGenerationWatcher). This is checked at most once in every
+ * REVALIDATE_INTERVAL.
+ */
+class RelationGraphCache
+{
+public:
+  RelationGraphCache(std::shared_ptr<odb::database> db_);
+
+  /**
+   * Returns the graph of the given relation kind. This function has to be
+   * called in a database transaction.
+   */
+  std::shared_ptr<const RelationGraph> get(model::CppRelation::Kind kind_);
+
+private:
+  static constexpr std::chrono::seconds REVALIDATE_INTERVAL{5};
+
+  /**
+   * This function drops every graph if the parse generation of the database
+   * has changed since the last check.
+   */
+  void revalidate();
+
+  std::shared_ptr<odb::database> _db;
+
+  std::map<
+    model::CppRelation::Kind,
+    std::shared_ptr<const RelationGraph>> _graphs;
+  std::mutex _mutex;
+
+  ParseGenerationWatcher _generation;
+};
+
+} // language
+} // service
+} // cc
+
+#endif // CC_SERVICE_LANGUAGE_RELATIONGRAPH_H
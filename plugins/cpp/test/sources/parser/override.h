@@ -0,0 +1,17 @@
+#ifndef CC_CPP_TEST_OVERRIDE_H
+#define CC_CPP_TEST_OVERRIDE_H
+
+// This header is included by two translation units. Only one of them indexes
+// the base class, the derived classes are in both of them.
+
+class OverrideBase
+{
+public:
+  virtual ~OverrideBase() {}
+
+  virtual int value() const;
+
+  virtual void print() {}
+};
+
+#endif
@@ -0,0 +1,15 @@
+#include "override.h"
+
+class OverrideDerived1 : public OverrideBase
+{
+public:
+  int value() const override { return 1; }
+
+  void print() override {}
+};
+
+int overrideValue1()
+{
+  OverrideDerived1 d;
+  return d.value();
+}
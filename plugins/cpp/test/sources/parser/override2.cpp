@@ -0,0 +1,15 @@
+#include "override.h"
+
+class OverrideDerived2 : public OverrideBase
+{
+public:
+  int value() const override { return 2; }
+
+  void print() override {}
+};
+
+int overrideValue2()
+{
+  OverrideDerived2 d;
+  return d.value();
+}
@@ -13,6 +13,8 @@
 #include <model/cppnamespace-odb.hxx>
 #include <model/cpprecord.h>
 #include <model/cpprecord-odb.hxx>
+#include <model/cpprelation.h>
+#include <model/cpprelation-odb.hxx>
 #include <model/cpptypedef.h>
 #include <model/cpptypedef-odb.hxx>
 #include <model/cppvariable.h>
@@ -33,6 +35,7 @@ using QCppEnum = odb::query<model::CppEnum>;
 using QCppEnumConstant = odb::query<model::CppEnumConstant>;
 using QCppNamespace = odb::query<model::CppNamespace>;
 using QCppRecord = odb::query<model::CppRecord>;
+using QCppRelation = odb::query<model::CppRelation>;
 using QCppTypedef = odb::query<model::CppTypedef>;
 using QCppVariable = odb::query<model::CppVariable>;
 using QFile = odb::query<model::File>;
@@ -768,4 +771,35 @@ TEST_F(CppParserTest, Using)
       EXPECT_EQ(astNode.symbolType, model::CppAstNode::SymbolType::Function);
     }
   });
-}
\ No newline at end of file
+}
+
+TEST_F(CppParserTest, OverrideAcrossTranslationUnits)
+{
+  _transaction([&, this] {
+    // The base class is in a header which is indexed by only one of the two
+    // translation units, but the methods of both derived classes override
+    // its methods.
+    for (const char* method : {"value", "print"})
+    {
+      std::string base = std::string("OverrideBase::") + method;
+
+      model::CppFunction baseFunc = _db->query_value<model::CppFunction>(
+        QCppFunction::qualifiedName == base);
+
+      for (const char* derived : {"OverrideDerived1", "OverrideDerived2"})
+      {
+        model::CppFunction derivedFunc = _db->query_value<model::CppFunction>(
+          QCppFunction::qualifiedName == std::string(derived) + "::" + method);
+
+        odb::result<model::CppRelation> relations
+          = _db->query<model::CppRelation>(
+            QCppRelation::kind == model::CppRelation::Kind::Override &&
+            QCppRelation::lhs == derivedFunc.entityHash &&
+            QCppRelation::rhs == baseFunc.entityHash);
+
+        EXPECT_FALSE(relations.empty())
+          << derived << "::" << method << " doesn't override " << base;
+      }
+    }
+  });
+}
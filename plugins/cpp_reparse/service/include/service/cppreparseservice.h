@@ -35,7 +35,7 @@ class CppReparseServiceHandler: virtual public CppReparseServiceIf
 public:
   CppReparseServiceHandler(
     std::shared_ptr<odb::database> db_,
-    std::shared_ptr<std::string> /* datadir_ */,
+    std::shared_ptr<std::string> datadir_,
     const cc::webserver::ServerContext& context_);
 
   ~CppReparseServiceHandler();
@@ -1,7 +1,16 @@
 #ifndef CC_SERVICE_CPPREPARSESERVICE_REPARSER_H
 #define CC_SERVICE_CPPREPARSESERVICE_REPARSER_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include <boost/variant.hpp>
 
@@ -33,12 +42,25 @@ class ASTCache;
 class CppReparser
 {
 public:
+  typedef boost::variant<std::shared_ptr<clang::ASTUnit>, std::string>
+    ASTResult;
+
+  /**
+   * @param recentFilesPath_ The file in which the most recently viewed
+   * translation units are recorded. If empty, nothing is recorded.
+   * @param prewarmCount_ The number of most recently viewed translation units
+   * whose AST is built in the background on construction, and so the number of
+   * the recorded ones. The list is saved by a background thread, at most once
+   * in every SAVE_RECENT_FILES_INTERVAL, and on destruction.
+   */
   CppReparser(
     std::shared_ptr<odb::database> db_,
-    std::shared_ptr<ASTCache> astCache_);
+    std::shared_ptr<ASTCache> astCache_,
+    const std::string& recentFilesPath_ = std::string(),
+    std::size_t prewarmCount_ = 0);
   CppReparser(const CppReparser&) = delete;
   CppReparser& operator=(const CppReparser&) = delete;
-  ~CppReparser() = default;
+  ~CppReparser();
 
   /**
    * Obtain the compilation command that used the given file as source file.
@@ -52,14 +74,15 @@ public:
   getCompilationCommandForFile(const core::FileId& fileId_);
 
   /**
-   * Returns the ASTUnit instance for the given source file
+   * Returns the ASTUnit instance for the given source file. If the AST of the
+   * file is being built by another thread then this function waits for that
+   * build instead of starting a new one.
    * @param fileId_ The file ID of the file to build the AST for.
    * @return An ASTUnit pointer, on which ASTConsumers can be executed. If an
    * error happened and the AST could not be obtained, a string explaining the
    * error is returned.
    */
-  boost::variant<std::shared_ptr<clang::ASTUnit>, std::string>
-  getASTForTranslationUnitFile(const core::FileId& fileId_);
+  ASTResult getASTForTranslationUnitFile(const core::FileId& fileId_);
 
 private:
   std::shared_ptr<odb::database> _db;
@@ -67,6 +90,54 @@ private:
   std::shared_ptr<ASTCache> _astCache;
 
   std::string getFilenameForId(const core::FileId& fileId_);
+
+  /**
+   * Looks up the AST in the cache, or builds it if it isn't there.
+   */
+  ASTResult fetchAST(const core::FileId& fileId_);
+
+  static constexpr std::chrono::seconds SAVE_RECENT_FILES_INTERVAL{10};
+
+  /**
+   * Moves the given file to the front of the most recently viewed files. The
+   * list is saved later by the background thread.
+   */
+  void recordView(const core::FileId& fileId_);
+
+  /**
+   * The function of the background thread: it prewarms the given files, then
+   * saves the list of the recently viewed files whenever it changes, until
+   * _stop is set.
+   */
+  void background(std::deque<core::FileId> files_);
+
+  /**
+   * Builds the ASTs of the given files one by one, until _stop is set.
+   * The files are ordered from the most recently viewed one.
+   */
+  void prewarm(const std::deque<core::FileId>& files_);
+
+  /**
+   * Writes the given list of recently viewed files to _recentFilesPath.
+   */
+  void saveRecentFiles(const std::deque<core::FileId>& files_);
+
+  /**
+   * The builds in progress. The threads requesting the same AST wait for the
+   * future of the first one.
+   */
+  std::map<core::FileId, std::shared_future<ASTResult>> _inFlight;
+  std::mutex _inFlightLock;
+
+  std::string _recentFilesPath;
+  std::size_t _prewarmCount;
+  std::deque<core::FileId> _recentFiles;
+  bool _recentFilesDirty;
+  std::mutex _recentFilesLock;
+  std::condition_variable _recentFilesChanged;
+
+  std::atomic_bool _stop;
+  std::thread _backgroundThread;
 };
 
 } // namespace reparse
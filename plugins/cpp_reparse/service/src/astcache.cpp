@@ -1,11 +1,65 @@
 #include <algorithm>
+#include <utility>
+#include <vector>
 
 #include <clang/Frontend/ASTUnit.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/PCHContainerOperations.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
 
 #include <util/logutil.h>
 
 #include "astcache.h"
 
+namespace
+{
+
+/**
+ * Estimates the memory used by the given AST: the allocations of the AST
+ * context, the source manager and the preprocessor. The memory mapped source
+ * buffers are not counted, because they are backed by the files.
+ */
+size_t estimateMemory(const clang::ASTUnit& AST_)
+{
+  const clang::ASTContext& context = AST_.getASTContext();
+  const clang::SourceManager& sourceManager = AST_.getSourceManager();
+
+  return context.getASTAllocatedMemory()
+    + context.getSideTableAllocatedMemory()
+    + sourceManager.getDataStructureSizes()
+    + sourceManager.getMemoryBufferSizes().malloc_bytes
+    + AST_.getPreprocessor().getTotalMemory();
+}
+
+/**
+ * Deserializes an AST saved by ASTUnit::Save(). Returns nullptr on error.
+ */
+std::unique_ptr<clang::ASTUnit> loadAST(const std::string& path_)
+{
+  clang::PCHContainerOperations pchOperations;
+
+  clang::IntrusiveRefCntPtr<clang::DiagnosticsEngine> diags =
+    clang::CompilerInstance::createDiagnostics(
+      new clang::DiagnosticOptions(), new clang::IgnoringDiagConsumer());
+
+  return clang::ASTUnit::LoadFromASTFile(
+    path_,
+    pchOperations.getRawReader(),
+    clang::ASTUnit::LoadEverything,
+    diags,
+    clang::FileSystemOptions(),
+    /* UseDebugInfo = */ false,
+    /* OnlyLocalDecls = */ false,
+    llvm::None,
+    clang::CaptureDiagsKind::None,
+    /* AllowPCHWithCompilerErrors = */ true);
+}
+
+} // namespace (anonymous)
+
 namespace cc
 {
 
@@ -17,58 +71,175 @@ namespace reparse
 
 using namespace clang;
 
-ASTCache::ASTCache(size_t maxCacheSize_)
-  : _maxCacheSize(maxCacheSize_)
-{}
+ASTCache::ASTCache(
+  size_t maxCacheSize_,
+  size_t maxMemory_,
+  const std::string& diskCacheDir_)
+  : _maxCacheSize(maxCacheSize_),
+    _maxMemory(maxMemory_),
+    _memory(0),
+    _diskCacheDir(diskCacheDir_)
+{
+  if (_diskCacheDir.empty())
+    return;
+
+  // The ASTs saved by a previous run may belong to an outdated database.
+  llvm::sys::fs::remove_directories(_diskCacheDir);
+
+  if (std::error_code ec = llvm::sys::fs::create_directories(_diskCacheDir))
+  {
+    LOG(warning) << "Failed to create AST cache directory " << _diskCacheDir
+                 << ": " << ec.message() << ". Evicted ASTs will be dropped.";
+    _diskCacheDir.clear();
+  }
+}
 
 std::shared_ptr<clang::ASTUnit> ASTCache::getAST(const core::FileId& id_)
 {
-  std::lock_guard<std::mutex> lock(_lock);
-  auto it = _cache.find(id_);
-  if (it == _cache.end())
+  std::string path;
+
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    auto it = _cache.find(id_);
+    if (it != _cache.end())
+      return it->second.getAST();
+
+    auto diskIt = _diskCache.find(id_);
+    if (diskIt == _diskCache.end())
+      return nullptr;
+
+    path = std::move(diskIt->second);
+    _diskCache.erase(diskIt);
+  }
+
+  LOG(debug) << "Loading AST for " << id_ << " from " << path << "...";
+
+  std::unique_ptr<ASTUnit> AST = loadAST(path);
+  if (!AST)
+  {
+    LOG(warning) << "Failed to load AST for " << id_ << " from " << path;
+    llvm::sys::fs::remove(path);
     return nullptr;
+  }
 
-  return it->second.getAST();
+  return storeAST(id_, std::move(AST), true);
 }
 
 std::shared_ptr<ASTUnit> ASTCache::storeAST(
   const core::FileId& id_,
   std::unique_ptr<ASTUnit> AST_)
 {
-  if (_cache.size() >= _maxCacheSize)
-    pruneEntries();
+  return storeAST(id_, std::move(AST_), false);
+}
 
-  std::lock_guard<std::mutex> lock(_lock);
-  auto it = _cache.find(id_);
-  if (it != _cache.end())
-    // If the key already exists in the map, it has to be overwritten.
-    // This cannot be done pre-C++17 without clearing the element first.
-    _cache.erase(it);
+std::shared_ptr<ASTUnit> ASTCache::storeAST(
+  const core::FileId& id_,
+  std::unique_ptr<ASTUnit> AST_,
+  bool onDisk_)
+{
+  std::shared_ptr<ASTUnit> result;
+
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    auto it = _cache.find(id_);
+    if (it != _cache.end())
+    {
+      // If the key already exists in the map, it has to be overwritten.
+      // This cannot be done pre-C++17 without clearing the element first.
+      _memory -= it->second.memory();
+      _cache.erase(it);
+    }
+
+    if (!onDisk_)
+      _diskCache.erase(id_);
+
+    auto inserted = _cache.emplace(
+      id_, ASTCacheEntry(std::move(AST_), onDisk_));
+    _memory += inserted.first->second.memory();
+    result = inserted.first->second.getAST();
+  }
+
+  // The new AST is referenced by result, so it is not pruned.
+  pruneEntries();
 
-  auto result = _cache.emplace(id_, std::move(AST_));
-  return result.first->second.getAST();
+  return result;
+}
+
+bool ASTCache::hasDiskCache() const
+{
+  return !_diskCacheDir.empty();
 }
 
 void ASTCache::pruneEntries()
 {
-  std::lock_guard<std::mutex> lock(_lock);
+  std::vector<std::pair<core::FileId, std::shared_ptr<ASTUnit>>> toSave;
+
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    while (_cache.size() > _maxCacheSize || _memory > _maxMemory)
+    {
+      // Remove the element which wasn't touched for the longest time. ASTs
+      // in use are skipped, removing them wouldn't free any memory.
+      auto elemToRemove = _cache.end();
+      for (auto it = _cache.begin(); it != _cache.end(); ++it)
+        if (it->second.referenceCount() == 0 &&
+            (elemToRemove == _cache.end() ||
+             it->second.lastHit() < elemToRemove->second.lastHit()))
+          elemToRemove = it;
+
+      if (elemToRemove == _cache.end())
+        break;
 
-  while (_cache.size() >= _maxCacheSize)
+      if (hasDiskCache())
+      {
+        if (elemToRemove->second.onDisk())
+          _diskCache[elemToRemove->first] = diskCachePath(elemToRemove->first);
+        else
+          toSave.emplace_back(
+            elemToRemove->first, elemToRemove->second.getAST());
+      }
+
+      _memory -= elemToRemove->second.memory();
+      _cache.erase(elemToRemove);
+    }
+  }
+
+  // Serializing an AST takes a long time, so it is done without holding the
+  // lock. If the AST is requested in the meantime, the file is parsed again.
+  for (auto& item : toSave)
   {
-    // For now, remove the element who wasn't touched for the longest time.
-    auto elemToRemove = std::min_element(
-        _cache.begin(), _cache.end(),
-        [](const auto& lhs, const auto& rhs)
-        {
-          return lhs.second.lastHit() < rhs.second.lastHit();
-        });
-
-    _cache.erase(elemToRemove);
+    std::string path = diskCachePath(item.first);
+
+    if (item.second->Save(path))
+    {
+      LOG(warning) << "Failed to save AST for " << item.first << " to "
+                   << path;
+      llvm::sys::fs::remove(path);
+      continue;
+    }
+
+    LOG(debug) << "Saved AST for " << item.first << " to " << path;
+
+    std::lock_guard<std::mutex> lock(_lock);
+    if (_cache.find(item.first) == _cache.end())
+      _diskCache[item.first] = std::move(path);
   }
 }
 
-ASTCache::ASTCacheEntry::ASTCacheEntry(std::unique_ptr<clang::ASTUnit> AST_)
+std::string ASTCache::diskCachePath(const core::FileId& id_) const
+{
+  llvm::SmallString<128> path(_diskCacheDir);
+  llvm::sys::path::append(path, std::to_string(std::stoull(id_)) + ".ast");
+  return path.str().str();
+}
+
+ASTCache::ASTCacheEntry::ASTCacheEntry(
+  std::unique_ptr<clang::ASTUnit> AST_,
+  bool onDisk_)
   : _AST(std::move(AST_)),
+    _memory(estimateMemory(*_AST)),
+    _onDisk(onDisk_),
     _hitCount(0),
     _lastHit(std::chrono::steady_clock::now())
 {}
@@ -98,6 +269,16 @@ size_t ASTCache::ASTCacheEntry::referenceCount() const
   return useCount - 1;
 }
 
+size_t ASTCache::ASTCacheEntry::memory() const
+{
+  return _memory;
+}
+
+bool ASTCache::ASTCacheEntry::onDisk() const
+{
+  return _onDisk;
+}
+
 } // namespace language
 } // namespace service
 } // namespace cc
@@ -2,9 +2,11 @@
 #define CC_SERVICE_CPPREPARSESERVICE_ASTCACHE_H
 
 #include <chrono>
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <string>
 
 // Required for the Thrift objects, such as core::FileId.
 #include "cppreparse_types.h"
@@ -30,17 +32,32 @@ namespace reparse
  *
  * This class owns the ASTUnit instances cached. It is expected that this
  * class outlives the execution of FrontendActions over an AST.
+ *
+ * The cache is bounded both by the number of ASTs and by their estimated
+ * memory usage. If a directory is given for the disk cache then evicted ASTs
+ * are serialized there and deserialized on the next request for them, which
+ * is much cheaper than parsing the file again.
  */
 class ASTCache
 {
 public:
 
   /**
-   * @param maxCacheSize_ The maximum size of the cache above which automatic
-   * pruning of old entries will take place. This is not an absolute limit, the
-   * cache is allowed to overfill in case no more entries could be pruned.
+   * @param maxCacheSize_ The maximum number of ASTs kept in memory above which
+   * automatic pruning of old entries will take place.
+   * @param maxMemory_ The maximum estimated memory usage in bytes of the ASTs
+   * kept in memory.
+   * @param diskCacheDir_ The directory in which the evicted ASTs are stored.
+   * If empty, the evicted ASTs are dropped. The contents of the directory are
+   * removed.
+   *
+   * These are not absolute limits, the cache is allowed to overfill in case
+   * no more entries could be pruned, because the ASTs are in use.
    */
-  ASTCache(size_t maxCacheSize_);
+  ASTCache(
+    size_t maxCacheSize_,
+    size_t maxMemory_ = SIZE_MAX,
+    const std::string& diskCacheDir_ = std::string());
 
   ASTCache(const ASTCache&) = delete;
   ASTCache& operator=(const ASTCache&) = delete;
@@ -48,7 +65,7 @@ public:
 
   /**
    * Retrieves the AST stored for the given file ID, or a nullptr if none is
-   * stored.
+   * stored. If the AST was evicted to the disk cache, it is loaded from there.
    */
   std::shared_ptr<clang::ASTUnit> getAST(const core::FileId& id_);
 
@@ -61,12 +78,19 @@ public:
     const core::FileId& id_,
     std::unique_ptr<clang::ASTUnit> AST_);
 
+  /**
+   * Returns true if the evicted ASTs are saved to the disk. In this case the
+   * contents of the source files have to be embedded in the ASTs, because the
+   * files are read from the database instead of the file system.
+   */
+  bool hasDiskCache() const;
+
 private:
 
   class ASTCacheEntry
   {
   public:
-    ASTCacheEntry(std::unique_ptr<clang::ASTUnit> AST_);
+    ASTCacheEntry(std::unique_ptr<clang::ASTUnit> AST_, bool onDisk_);
     ASTCacheEntry(const ASTCacheEntry&) = delete;
     ASTCacheEntry(ASTCacheEntry&&) = default;
     ~ASTCacheEntry() = default;
@@ -85,9 +109,24 @@ private:
      */
     size_t referenceCount() const;
 
+    /**
+     * Returns the estimated memory usage of the AST in bytes, computed when
+     * the AST was stored.
+     */
+    size_t memory() const;
+
+    /**
+     * Returns true if an up-to-date serialized copy of the AST exists in the
+     * disk cache.
+     */
+    bool onDisk() const;
+
   private:
     std::shared_ptr<clang::ASTUnit> _AST;
 
+    size_t _memory;
+    bool _onDisk;
+
     /**
      * The number of times the AST has been retrieved.
      */
@@ -102,13 +141,39 @@ private:
 
   /**
    * Handles the clearing of the cache if there are more elements than
-   * _maxCacheSize stored.
+   * _maxCacheSize stored, or they use more memory than _maxMemory. The pruned
+   * ASTs are saved to the disk cache, if any.
    */
   void pruneEntries();
 
+  std::shared_ptr<clang::ASTUnit> storeAST(
+    const core::FileId& id_,
+    std::unique_ptr<clang::ASTUnit> AST_,
+    bool onDisk_);
+
+  std::string diskCachePath(const core::FileId& id_) const;
+
   std::mutex _lock;
+
+  /**
+   * The ASTs in memory.
+   */
   std::map<core::FileId, ASTCacheEntry> _cache;
+
+  /**
+   * The files whose AST is in the disk cache but not in memory.
+   */
+  std::map<core::FileId, std::string> _diskCache;
+
   size_t _maxCacheSize;
+  size_t _maxMemory;
+
+  /**
+   * The sum of the estimated memory usage of the ASTs in _cache.
+   */
+  size_t _memory;
+
+  std::string _diskCacheDir;
 };
 
 } // namespace reparse
@@ -38,7 +38,7 @@ using namespace clang::tooling;
 
 CppReparseServiceHandler::CppReparseServiceHandler(
   std::shared_ptr<odb::database> db_,
-  std::shared_ptr<std::string> /* datadir_ */,
+  std::shared_ptr<std::string> datadir_,
   const cc::webserver::ServerContext& context_)
   : _db(db_),
     _transaction(db_),
@@ -56,8 +56,18 @@ CppReparseServiceHandler::CppReparseServiceHandler(
       maxCacheSize = jobs;
     }
 
-    _astCache = std::make_shared<ASTCache>(maxCacheSize);
-    _reparser = std::make_unique<CppReparser>(_db, _astCache);
+    size_t maxMemory =
+      _config["ast-cache-memory-limit"].as<size_t>() * 1024 * 1024;
+
+    std::string diskCacheDir;
+    if (_config["ast-cache-disk"].as<bool>())
+      diskCacheDir = *datadir_ + "/cppreparse/ast";
+
+    _astCache = std::make_shared<ASTCache>(
+      maxCacheSize, maxMemory, diskCacheDir);
+    _reparser = std::make_unique<CppReparser>(
+      _db, _astCache, *datadir_ + "/cppreparse/recent",
+      _config["ast-cache-prewarm"].as<size_t>());
   }
 }
 
@@ -2,14 +2,19 @@
 #include <chrono>
 #include <deque>
 #include <functional>
+#include <unordered_set>
 
 #include <llvm/ADT/SmallString.h>
 #include <llvm/Support/Path.h>
 
+#include <util/dbutil.h>
+
 #include <model/file.h>
 #include <model/file-odb.hxx>
 #include <model/filecontent.h>
 #include <model/filecontent-odb.hxx>
+#include <model/cppheaderinclusion.h>
+#include <model/cppheaderinclusion-odb.hxx>
 
 #include "databasefilesystem.h"
 
@@ -24,37 +29,7 @@ using namespace cc;
 typedef odb::query<model::File> FileQuery;
 typedef odb::result<model::File> FileResult;
 typedef odb::query<model::FileContentLength> FileContentLengthQuery;
-typedef odb::result<model::FileContentLength> FileContentLengthResult;
-
-/**
- * Retrieve a file by path from the database.
- */
-model::FilePtr getFile(
-  odb::database& db_,
-  const std::string& path_)
-{
-  model::FilePtr file;
-  util::OdbTransaction {db_} ([&]() {
-    file = db_.query_one<model::File>(FileQuery::path == path_);
-  });
-  return file;
-}
-
-/**
- * Retrieve the children of the given path from the database.
- */
-std::vector<model::FilePtr> getChildrenOfFile(
-  odb::database& db_,
-  const model::FileId& fileId_)
-{
-  std::vector<model::FilePtr> result;
-  util::OdbTransaction {db_} ([&]() {
-    FileResult res = db_.query<model::File>(FileQuery::parent == fileId_);
-    for (auto fp : res)
-      result.push_back(std::make_shared<model::File>(std::move(fp)));
-  });
-  return result;
-}
+typedef odb::query<model::CppHeaderInclusion> HeaderInclusionQuery;
 
 directory_entry fileToEntry(const model::File& file_)
 {
@@ -71,28 +46,14 @@ directory_entry fileToEntry(const model::File& file_)
   return {file_.path, fileType};
 }
 
-Status fileToStatus(
-  odb::database& db_,
-  const model::File& file_)
+Status fileToStatus(const model::File& file_, std::size_t size_)
 {
   using namespace llvm::sys::fs;
   vfs::directory_entry entry = fileToEntry(file_);
 
-  size_t size = 0;
-  if (file_.content)
-    util::OdbTransaction {db_} ([&]() {
-      // For some weird thing, query_one produces an error here if one attempts
-      // to use a std::shared_ptr as the result of the query_one().
-      FileContentLengthResult res = db_.query<model::FileContentLength>(
-        FileContentLengthQuery::hash == file_.content.object_id());
-
-      if (!res.empty())
-        size = res.begin()->size;
-    });
-
   return Status(file_.path, UniqueID(0, file_.id),
                 sys::toTimePoint(file_.timestamp), 0, 0,
-                size, entry.type(), perms::all_read);
+                size_, entry.type(), perms::all_read);
 }
 
 /**
@@ -102,10 +63,9 @@ Status fileToStatus(
 class DatabaseDirectoryIterator : public vfs::detail::DirIterImpl
 {
 public:
-  DatabaseDirectoryIterator(odb::database& db_,
-                            const model::FilePtr& dir_,
+  DatabaseDirectoryIterator(const model::FilePtr& dir_,
+                            const std::vector<model::FilePtr>& children_,
                             std::error_code& ec_)
-    : _db(db_)
   {
     if (dir_->type != model::File::DIRECTORY_TYPE)
     {
@@ -113,7 +73,7 @@ public:
       return;
     }
 
-    for (const auto& fp : getChildrenOfFile(db_, dir_->id))
+    for (const auto& fp : children_)
       _remainingEntries.push_back(fp);
 
     // This sets the iterator's current element to the first one, if exists.
@@ -136,7 +96,6 @@ public:
   }
 
 private:
-  odb::database& _db;
   std::deque<model::FilePtr> _remainingEntries;
 };
 
@@ -193,25 +152,159 @@ namespace service
 namespace reparse
 {
 
-DatabaseFileSystem::DatabaseFileSystem(std::shared_ptr<odb::database> db_)
+DatabaseFileSystem::DatabaseFileSystem(
+  std::shared_ptr<odb::database> db_,
+  model::FileId mainFile_)
   : _db(db_),
     _transaction(db_),
     _currentWorkingDirectory("/")
-{}
+{
+  if (mainFile_)
+    prefetch(mainFile_);
+}
+
+void DatabaseFileSystem::prefetch(model::FileId mainFile_)
+{
+  _transaction([&, this](){
+    //--- Collect the include closure level by level ---//
+
+    std::unordered_set<model::FileId> visited{mainFile_};
+    std::vector<model::FileId> frontier{mainFile_};
+
+    while (!frontier.empty())
+    {
+      std::vector<model::FileId> next;
+
+      util::forEachChunk(frontier, [&, this](auto begin_, auto end_)
+      {
+        for (const model::CppHeaderInclusion& inclusion
+          : _db->query<model::CppHeaderInclusion>(
+              HeaderInclusionQuery::includer.in_range(begin_, end_)))
+        {
+          model::FileId included = inclusion.included.object_id();
+          if (visited.insert(included).second)
+            next.push_back(included);
+        }
+      });
+
+      frontier = std::move(next);
+    }
+
+    //--- Load the files and their directories ---//
+
+    frontier.assign(visited.begin(), visited.end());
+
+    while (!frontier.empty())
+    {
+      std::vector<model::FilePtr> files;
+      std::vector<model::FileId> next;
+
+      util::forEachChunk(frontier, [&, this](auto begin_, auto end_)
+      {
+        for (const model::File& file : _db->query<model::File>(
+          FileQuery::id.in_range(begin_, end_)))
+        {
+          if (file.parent)
+          {
+            model::FileId parent = file.parent.object_id();
+            if (visited.insert(parent).second)
+              next.push_back(parent);
+          }
+
+          files.push_back(std::make_shared<model::File>(file));
+        }
+      });
+
+      cacheFiles(files);
+      frontier = std::move(next);
+    }
+  });
+}
+
+void DatabaseFileSystem::cacheFiles(const std::vector<model::FilePtr>& files_)
+{
+  std::unordered_map<std::string, std::size_t> sizes;
+  std::vector<std::string> hashes;
+
+  for (const model::FilePtr& file : files_)
+    if (file->content)
+      hashes.push_back(file->content.object_id());
+
+  util::forEachChunk(hashes, [&, this](auto begin_, auto end_)
+  {
+    for (const model::FileContentLength& length
+      : _db->query<model::FileContentLength>(
+          FileContentLengthQuery::hash.in_range(begin_, end_)))
+      sizes[length.hash] = length.size;
+  });
+
+  for (const model::FilePtr& file : files_)
+  {
+    std::size_t size = 0;
+
+    if (file->content)
+    {
+      auto it = sizes.find(file->content.object_id());
+      if (it != sizes.end())
+        size = it->second;
+    }
+
+    _files[file->path] = CachedFile{file, size};
+  }
+}
+
+const DatabaseFileSystem::CachedFile& DatabaseFileSystem::getFile(
+  const std::string& path_)
+{
+  auto it = _files.find(path_);
+  if (it != _files.end())
+    return it->second;
+
+  _transaction([&, this](){
+    model::FilePtr file = _db->query_one<model::File>(
+      FileQuery::path == path_);
+
+    if (file)
+      cacheFiles({file});
+    else
+      _files[path_] = CachedFile{nullptr, 0};
+  });
+
+  return _files.at(path_);
+}
+
+const std::vector<model::FilePtr>& DatabaseFileSystem::getChildrenOfFile(
+  model::FileId dir_)
+{
+  auto it = _children.find(dir_);
+  if (it != _children.end())
+    return it->second;
+
+  std::vector<model::FilePtr>& result = _children[dir_];
+
+  _transaction([&, this](){
+    FileResult res = _db->query<model::File>(FileQuery::parent == dir_);
+    for (auto fp : res)
+      result.push_back(std::make_shared<model::File>(std::move(fp)));
+  });
+
+  return result;
+}
 
 ErrorOr<Status> DatabaseFileSystem::status(const Twine& path_)
 {
-  model::FilePtr file = getFile(*_db, path_.str());
-  if (!file)
+  const CachedFile& cached = getFile(path_.str());
+  if (!cached.file)
     return std::error_code(ENOENT, std::generic_category());
 
-  return fileToStatus(*_db, *file);
+  return fileToStatus(*cached.file, cached.size);
 }
 
 ErrorOr<std::unique_ptr<File>>
 DatabaseFileSystem::openFileForRead(const Twine& path_)
 {
-  model::FilePtr file = getFile(*_db, path_.str());
+  const CachedFile& cached = getFile(path_.str());
+  model::FilePtr file = cached.file;
   if (!file)
     return std::error_code(ENOENT, std::generic_category());
   if (file->type == model::File::DIRECTORY_TYPE)
@@ -220,10 +313,13 @@ DatabaseFileSystem::openFileForRead(const Twine& path_)
     return std::error_code(EIO, std::generic_category());
 
   std::unique_ptr<File> dbFile;
-  _transaction([&](){
+  _transaction([&, this](){
+    // The content is loaded into a copy, so that the cached file doesn't keep
+    // it in memory.
+    model::File copy = *file;
     dbFile = std::make_unique<DatabaseFile>(
-      fileToStatus(*_db, *file),
-      std::move(file->content.load()->content));
+      fileToStatus(*file, cached.size),
+      std::move(copy.content.load()->content));
   });
   return std::move(dbFile);
 }
@@ -231,10 +327,10 @@ DatabaseFileSystem::openFileForRead(const Twine& path_)
 directory_iterator
 DatabaseFileSystem::dir_begin(const Twine& dir_, std::error_code& ec_)
 {
-  model::FilePtr dirFile = getFile(*_db, dir_.str());
+  model::FilePtr dirFile = getFile(dir_.str()).file;
   if (dirFile &&  dirFile->type == model::File::DIRECTORY_TYPE)
     return directory_iterator(std::make_shared<DatabaseDirectoryIterator>(
-      *_db, dirFile, ec_));
+      dirFile, getChildrenOfFile(dirFile->id), ec_));
 
   // If the folder does not exist, or isn't a folder, return an end-iterator.
   return directory_iterator();
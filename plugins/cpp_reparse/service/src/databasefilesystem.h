@@ -2,11 +2,16 @@
 #define CC_SERVICE_CPPREPARSESERVICE_DATABASEFILESYSTEM_H
 
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <llvm/Support/VirtualFileSystem.h>
 
 #include <odb/database.hxx>
 
+#include <model/file.h>
+
 #include <util/odbtransaction.h>
 
 namespace cc
@@ -19,11 +24,22 @@ namespace reparse
 /**
  * A Clang Virtual File System implementation that retrieves file information
  * and contents from CodeCompass' database.
+ *
+ * The file metadata is cached for the lifetime of the instance, which is
+ * meant to be one reparse. The metadata of the files included by the
+ * translation unit and their directories is fetched in bulk on construction,
+ * so the status() calls of Clang don't need database round-trips.
  */
 class DatabaseFileSystem : public llvm::vfs::FileSystem
 {
 public:
-  DatabaseFileSystem(std::shared_ptr<odb::database> db_);
+  /**
+   * @param mainFile_ The translation unit to be parsed. If given, the
+   * metadata of the files it includes is prefetched.
+   */
+  DatabaseFileSystem(
+    std::shared_ptr<odb::database> db_,
+    model::FileId mainFile_ = 0);
 
   virtual ~DatabaseFileSystem() = default;
 
@@ -40,10 +56,49 @@ public:
   std::error_code setCurrentWorkingDirectory(const llvm::Twine& path_) override;
 
 private:
+  struct CachedFile
+  {
+    /**
+     * The file, or nullptr if the path doesn't exist in the database.
+     */
+    model::FilePtr file;
+
+    /**
+     * The size of the file content.
+     */
+    std::size_t size;
+  };
+
+  /**
+   * Loads the metadata of the include closure of the given file and the
+   * directories containing them.
+   */
+  void prefetch(model::FileId mainFile_);
+
+  /**
+   * Stores the given files in the cache, querying the size of their contents.
+   * This function has to be called in a database transaction.
+   */
+  void cacheFiles(const std::vector<model::FilePtr>& files_);
+
+  /**
+   * Returns the cached metadata of the file at the given path, querying it if
+   * it isn't cached yet.
+   */
+  const CachedFile& getFile(const std::string& path_);
+
+  /**
+   * Returns the children of the given directory.
+   */
+  const std::vector<model::FilePtr>& getChildrenOfFile(model::FileId dir_);
+
   std::shared_ptr<odb::database> _db;
   util::OdbTransaction _transaction;
 
   std::string _currentWorkingDirectory;
+
+  std::unordered_map<std::string, CachedFile> _files;
+  std::unordered_map<model::FileId, std::vector<model::FilePtr>> _children;
 };
 
 } //namespace reparse
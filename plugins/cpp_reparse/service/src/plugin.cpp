@@ -23,6 +23,21 @@ extern "C"
        "The maximum number of reparsed syntax trees that should be cached in "
        "memory.");
 
+    description.add_options()
+      ("ast-cache-memory-limit", po::value<size_t>()->default_value(4096),
+       "The estimated memory usage in MiB of the reparsed syntax trees above "
+       "which the least recently used ones are evicted from the memory.");
+
+    description.add_options()
+      ("ast-cache-disk", po::value<bool>()->default_value(false),
+       "Save the syntax trees evicted from the memory into the workspace, and "
+       "load them from there instead of parsing the file again.");
+
+    description.add_options()
+      ("ast-cache-prewarm", po::value<size_t>()->default_value(0),
+       "The number of most recently viewed files whose syntax tree is built "
+       "in the background when the server starts.");
+
     return description;
   }
 
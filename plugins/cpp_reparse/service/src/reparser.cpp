@@ -1,9 +1,16 @@
+#include <algorithm>
+#include <fstream>
+
 #include <boost/algorithm/string.hpp>
 
 #include <clang/Frontend/ASTUnit.h>
+#include <clang/Tooling/ArgumentsAdjusters.h>
 #include <clang/Tooling/CompilationDatabase.h>
 #include <clang/Tooling/Tooling.h>
 
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+
 #include <model/buildsourcetarget.h>
 #include <model/buildsourcetarget-odb.hxx>
 #include <model/file.h>
@@ -36,13 +43,148 @@ using namespace cc::service;
 using namespace clang;
 using namespace clang::tooling;
 
+constexpr std::chrono::seconds CppReparser::SAVE_RECENT_FILES_INTERVAL;
+
 CppReparser::CppReparser(
   std::shared_ptr<odb::database> db_,
-  std::shared_ptr<ASTCache> astCache_)
+  std::shared_ptr<ASTCache> astCache_,
+  const std::string& recentFilesPath_,
+  std::size_t prewarmCount_)
   : _db(db_),
     _transaction(db_),
-    _astCache(astCache_)
-{}
+    _astCache(astCache_),
+    _recentFilesPath(recentFilesPath_),
+    _prewarmCount(recentFilesPath_.empty() ? 0 : prewarmCount_),
+    _recentFilesDirty(false),
+    _stop(false)
+{
+  if (!_prewarmCount)
+    return;
+
+  std::ifstream recentFiles(_recentFilesPath);
+  std::string fileId;
+  while (std::getline(recentFiles, fileId) &&
+         _recentFiles.size() < _prewarmCount)
+    if (!fileId.empty())
+      _recentFiles.push_back(fileId);
+
+  _backgroundThread = std::thread(
+    &CppReparser::background, this, _recentFiles);
+}
+
+CppReparser::~CppReparser()
+{
+  {
+    std::lock_guard<std::mutex> lock(_recentFilesLock);
+    _stop = true;
+  }
+
+  _recentFilesChanged.notify_all();
+
+  if (_backgroundThread.joinable())
+    _backgroundThread.join();
+}
+
+void CppReparser::background(std::deque<core::FileId> files_)
+{
+  prewarm(files_);
+
+  std::unique_lock<std::mutex> lock(_recentFilesLock);
+
+  while (true)
+  {
+    _recentFilesChanged.wait(lock,
+      [this]{ return _recentFilesDirty || _stop; });
+
+    if (_recentFilesDirty)
+    {
+      std::deque<core::FileId> files = _recentFiles;
+      _recentFilesDirty = false;
+
+      lock.unlock();
+      saveRecentFiles(files);
+      lock.lock();
+    }
+
+    if (_stop)
+      break;
+
+    // The views in the meantime are saved together.
+    _recentFilesChanged.wait_for(lock, SAVE_RECENT_FILES_INTERVAL,
+      [this]{ return _stop.load(); });
+  }
+}
+
+void CppReparser::saveRecentFiles(const std::deque<core::FileId>& files_)
+{
+  llvm::sys::fs::create_directories(
+    llvm::sys::path::parent_path(_recentFilesPath));
+
+  std::ofstream recentFiles(_recentFilesPath);
+  for (const core::FileId& fileId : files_)
+    recentFiles << fileId << '\n';
+
+  if (!recentFiles)
+    LOG(warning) << "Failed to save the recently viewed files to "
+                 << _recentFilesPath;
+}
+
+void CppReparser::prewarm(const std::deque<core::FileId>& files_)
+{
+  if (files_.empty())
+    return;
+
+  LOG(info) << "Building the ASTs of " << files_.size()
+            << " recently viewed file(s) in the background...";
+
+  // The least recently viewed file is built first, so the order of the
+  // recently viewed files is kept when the builds are recorded, and the most
+  // recently viewed ASTs are the last ones to be evicted.
+  for (auto it = files_.rbegin(); it != files_.rend(); ++it)
+  {
+    const core::FileId& fileId = *it;
+
+    if (_stop)
+      return;
+
+    try
+    {
+      ASTResult result = getASTForTranslationUnitFile(fileId);
+      if (std::string* err = boost::get<std::string>(&result))
+        LOG(debug) << "Failed to prewarm the AST of " << fileId << ": "
+                   << *err;
+    }
+    catch (const std::exception& ex)
+    {
+      LOG(warning) << "Failed to prewarm the AST of " << fileId << ": "
+                   << ex.what();
+    }
+  }
+
+  LOG(info) << "Building the ASTs of recently viewed files finished.";
+}
+
+void CppReparser::recordView(const core::FileId& fileId_)
+{
+  if (!_prewarmCount)
+    return;
+
+  std::lock_guard<std::mutex> lock(_recentFilesLock);
+
+  if (!_recentFiles.empty() && _recentFiles.front() == fileId_)
+    return;
+
+  _recentFiles.erase(
+    std::remove(_recentFiles.begin(), _recentFiles.end(), fileId_),
+    _recentFiles.end());
+  _recentFiles.push_front(fileId_);
+
+  if (_recentFiles.size() > _prewarmCount)
+    _recentFiles.pop_back();
+
+  _recentFilesDirty = true;
+  _recentFilesChanged.notify_one();
+}
 
 std::string CppReparser::getFilenameForId(const core::FileId& fileId_)
 {
@@ -144,9 +286,57 @@ CppReparser::getCompilationCommandForFile(
   return std::move(compilationDb);
 }
 
-boost::variant<std::shared_ptr<clang::ASTUnit>, std::string>
-CppReparser::getASTForTranslationUnitFile(
+CppReparser::ASTResult CppReparser::getASTForTranslationUnitFile(
   const core::FileId& fileId_)
+{
+  std::promise<ASTResult> promise;
+
+  {
+    std::unique_lock<std::mutex> lock(_inFlightLock);
+
+    auto it = _inFlight.find(fileId_);
+    if (it != _inFlight.end())
+    {
+      std::shared_future<ASTResult> future = it->second;
+      lock.unlock();
+
+      LOG(debug) << "Waiting for the AST of " << fileId_
+                 << " being built by another request...";
+      return future.get();
+    }
+
+    _inFlight.emplace(fileId_, promise.get_future().share());
+  }
+
+  ASTResult result;
+
+  try
+  {
+    result = fetchAST(fileId_);
+  }
+  catch (...)
+  {
+    promise.set_exception(std::current_exception());
+
+    std::lock_guard<std::mutex> lock(_inFlightLock);
+    _inFlight.erase(fileId_);
+    throw;
+  }
+
+  promise.set_value(result);
+
+  {
+    std::lock_guard<std::mutex> lock(_inFlightLock);
+    _inFlight.erase(fileId_);
+  }
+
+  if (boost::get<std::shared_ptr<ASTUnit>>(&result))
+    recordView(fileId_);
+
+  return result;
+}
+
+CppReparser::ASTResult CppReparser::fetchAST(const core::FileId& fileId_)
 {
   std::shared_ptr<ASTUnit> AST = _astCache->getAST(fileId_);
   if (!AST)
@@ -162,7 +352,7 @@ CppReparser::getASTForTranslationUnitFile(
 
     // TODO: FIXME: Change this into the shortcutting overlay creation once the interface is upstreamed. (https://reviews.llvm.org/D45094)
     IntrusiveRefCntPtr<DatabaseFileSystem> dbfs(
-      new DatabaseFileSystem(_db));
+      new DatabaseFileSystem(_db, std::stoull(fileId_)));
     IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> overlayFs(
       new llvm::vfs::OverlayFileSystem(llvm::vfs::getRealFileSystem()));
     overlayFs->pushOverlay(dbfs);
@@ -175,6 +365,13 @@ CppReparser::getASTForTranslationUnitFile(
       *compileDb, getFilenameForId(fileId_),
       std::make_shared<clang::PCHContainerOperations>(), overlayFs);
 
+    if (_astCache->hasDiskCache())
+      // The ASTs saved to the disk cache are loaded without the database file
+      // system, so they have to contain the source files.
+      tool.appendArgumentsAdjuster(getInsertArgumentAdjuster(
+        {"-Xclang", "-fmodules-embed-all-files"},
+        ArgumentInsertPosition::END));
+
     std::vector<std::unique_ptr<ASTUnit>> vect;
     int error = tool.buildASTs(vect);
     if (error)
@@ -0,0 +1,170 @@
+/**
+ * Microbenchmark comparing the job throughput of util::PooledJobQueue with the
+ * previous, single queue based thread pool implementation.
+ *
+ * Usage: threadpoolbenchmark [number of jobs] [work units per job]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <util/threadpool.h>
+
+namespace
+{
+
+/**
+ * The thread pool implementation which was used before the work-stealing
+ * util::PooledJobQueue: one mutex protected queue, notification after every
+ * pop and 1 second polling while waiting.
+ */
+template <typename JobData, typename Function>
+class LegacyPooledJobQueue
+{
+public:
+  LegacyPooledJobQueue(size_t threadCount_, Function func_) : _die(false)
+  {
+    for (size_t i = 0; i < threadCount_; ++i)
+      _threads.emplace_back(&LegacyPooledJobQueue::worker, this, func_);
+  }
+
+  void enqueue(JobData jobInfo_)
+  {
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      _queue.push(jobInfo_);
+    }
+
+    _signal.notify_one();
+  }
+
+  void wait()
+  {
+    _die = true;
+    _signal.notify_all();
+
+    for (std::thread& t : _threads)
+    {
+      _signal.notify_all();
+      if (t.joinable())
+        t.join();
+    }
+  }
+
+private:
+  void worker(Function function_)
+  {
+    while (!(_die && _queue.empty()))
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      if (_queue.empty())
+      {
+        _signal.wait_for(lock, std::chrono::seconds(1), [this]()
+        {
+          return !_queue.empty();
+        });
+
+        lock.unlock();
+        _signal.notify_one();
+        continue;
+      }
+      else
+      {
+        JobData job = _queue.front();
+        _queue.pop();
+
+        lock.unlock();
+        _signal.notify_one();
+
+        function_(job);
+      }
+    }
+  }
+
+  std::mutex _lock;
+  std::condition_variable _signal;
+  std::atomic_bool _die;
+  std::queue<JobData> _queue;
+  std::vector<std::thread> _threads;
+};
+
+/**
+ * A job doing some CPU work which can't be optimised away.
+ */
+struct Work
+{
+  Work(std::size_t units_, std::atomic_size_t& sink_)
+    : units(units_), sink(sink_)
+  {
+  }
+
+  void operator()(std::size_t job_) const
+  {
+    std::size_t x = job_;
+    for (std::size_t i = 0; i < units; ++i)
+      x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    sink.fetch_add(x & 1, std::memory_order_relaxed);
+  }
+
+  std::size_t units;
+  std::atomic_size_t& sink;
+};
+
+template <typename Pool>
+double measure(std::size_t threads_, std::size_t jobs_, std::size_t units_)
+{
+  std::atomic_size_t sink(0);
+
+  auto start = std::chrono::steady_clock::now();
+
+  Pool pool(threads_, Work(units_, sink));
+  for (std::size_t i = 0; i < jobs_; ++i)
+    pool.enqueue(i);
+  pool.wait();
+
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  return jobs_ / elapsed.count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  std::size_t jobs = argc > 1 ? std::stoul(argv[1]) : 1000000;
+  std::size_t units = argc > 2 ? std::stoul(argv[2]) : 100;
+
+  std::cout
+    << "Jobs: " << jobs << ", work units per job: " << units << std::endl
+    << std::setw(8) << "threads"
+    << std::setw(16) << "legacy job/s"
+    << std::setw(16) << "stealing job/s"
+    << std::setw(10) << "speedup" << std::endl;
+
+  for (std::size_t threads = 1; threads <= 128; threads *= 2)
+  {
+    double legacy = measure<LegacyPooledJobQueue<std::size_t, Work>>(
+      threads, jobs, units);
+    double stealing = measure<cc::util::PooledJobQueue<std::size_t, Work>>(
+      threads, jobs, units);
+
+    std::cout
+      << std::setw(8) << threads
+      << std::setw(16) << std::fixed << std::setprecision(0) << legacy
+      << std::setw(16) << stealing
+      << std::setw(10) << std::setprecision(2) << stealing / legacy
+      << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef CC_UTIL_COMPRESSION_H
+#define CC_UTIL_COMPRESSION_H
+
+#include <string>
+
+namespace cc
+{
+namespace util
+{
+
+/**
+ * This function compresses the given data in gzip format, which can be sent
+ * as an HTTP response with "Content-Encoding: gzip".
+ * @param data_ Data to compress.
+ * @param size_ Size of the data in bytes.
+ * @param result_ The compressed data is written here.
+ * @param level_ Compression level from 1 (fastest) to 9 (smallest).
+ * @return False if the compression failed.
+ */
+bool gzipCompress(
+  const char* data_,
+  std::size_t size_,
+  std::string& result_,
+  int level_ = 6);
+
+}
+}
+
+#endif
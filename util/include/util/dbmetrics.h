@@ -0,0 +1,148 @@
+#ifndef CC_UTIL_DBMETRICS_H
+#define CC_UTIL_DBMETRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <odb/database.hxx>
+#include <odb/tracer.hxx>
+
+namespace cc
+{
+namespace util
+{
+
+/**
+ * Collects the metrics of the transactions and statements of a database and
+ * logs a summary periodically: the time waited for a pooled connection, the
+ * number of active transactions (each holds a connection) and the slowest
+ * statements.
+ *
+ * It is installed as the tracer of the database by connectDatabase(), the
+ * transactions are reported by OdbTransaction. The duration of a statement is
+ * measured from its execution until the next statement or the end of the
+ * transaction on the same thread, so it includes fetching the result.
+ *
+ * Every thread collects its statistics in its own shard, so the threads don't
+ * contend for a lock on every statement. The shards are merged when the
+ * summary is logged.
+ */
+class DatabaseMetrics : public odb::tracer
+{
+public:
+  typedef std::chrono::steady_clock::duration Duration;
+
+  DatabaseMetrics(std::string name_, std::chrono::seconds logInterval_);
+
+  /**
+   * This function returns the metrics of the database or nullptr if the
+   * metrics of the database are not collected.
+   */
+  static DatabaseMetrics* of(odb::database& db_);
+
+  /**
+   * This function is called when a transaction has got its connection.
+   * @param poolWait_ The time of waiting for the connection.
+   */
+  void transactionStarted(Duration poolWait_);
+
+  /**
+   * This function is called at the end of a transaction, either it was
+   * committed or rolled back.
+   */
+  void transactionFinished(Duration duration_);
+
+  using odb::tracer::execute;
+
+  void execute(odb::connection& conn_, const char* statement_) override;
+
+private:
+  struct StatementStatistics
+  {
+    std::size_t count = 0;
+    Duration total{0};
+    Duration max{0};
+  };
+
+  /**
+   * At most this many different statements are measured.
+   */
+  static constexpr std::size_t MAX_STATEMENTS = 1024;
+
+  /**
+   * The number of the slowest statements in the summary.
+   */
+  static constexpr std::size_t NUM_SLOWEST_STATEMENTS = 5;
+
+  /**
+   * Statements are truncated to this length in the summary.
+   */
+  static constexpr std::size_t MAX_LOGGED_STATEMENT_LENGTH = 300;
+
+  /**
+   * The statistics collected by one thread since the last summary. The mutex
+   * is locked by the thread for every update, but it is contended only when
+   * the summary is logged.
+   */
+  struct Shard
+  {
+    std::mutex mutex;
+    std::size_t transactions = 0;
+    Duration totalPoolWait{0};
+    Duration maxPoolWait{0};
+    Duration totalTransactionTime{0};
+    Duration maxTransactionTime{0};
+    std::unordered_map<std::string, StatementStatistics> statements;
+  };
+
+  /**
+   * Attributes the time since the start of the current statement of this
+   * thread to that statement.
+   */
+  static void finishStatement(std::chrono::steady_clock::time_point now_);
+
+  /**
+   * Returns the shard of the calling thread. It is created on the first call
+   * of the thread.
+   */
+  Shard& shard();
+
+  void recordStatement(const std::string& statement_, Duration duration_);
+
+  /**
+   * Merges the shards and logs the summary. _mutex has to be locked.
+   */
+  void logSummary(std::chrono::steady_clock::time_point now_);
+
+  const std::string _name;
+  const std::chrono::seconds _logInterval;
+
+  /**
+   * Identifies the shards of this object in the threads. The address is not
+   * enough, because a new object may be created at the same address.
+   */
+  const std::size_t _id;
+
+  std::atomic_int _active;
+  std::atomic_int _maxActive;
+
+  /**
+   * The time of the next summary, as the time since the epoch of the steady
+   * clock, so that it can be checked without locking _mutex.
+   */
+  std::atomic<std::chrono::steady_clock::rep> _nextLog;
+
+  std::mutex _mutex;
+  std::chrono::steady_clock::time_point _lastLog;
+  std::vector<std::shared_ptr<Shard>> _shards;
+};
+
+} // util
+} // cc
+
+#endif // CC_UTIL_DBMETRICS_H
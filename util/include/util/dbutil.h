@@ -1,10 +1,14 @@
 #ifndef CC_UTIL_DBUTIL_H
 #define CC_UTIL_DBUTIL_H
 
+#include <chrono>
+#include <cstddef>
 #include <memory>
 #include <string>
 
+#include <odb/connection.hxx>
 #include <odb/database.hxx>
+#include <odb/transaction.hxx>
 
 #ifdef DATABASE_PGSQL
 #  define SQL_ILIKE "ILIKE"
@@ -23,14 +27,116 @@ namespace cc
 {
 namespace util
 {
+
+/**
+ * Options of the connections of a database opened by connectDatabase().
+ */
+struct DatabaseOptions
+{
+  /**
+   * Maximum number of pooled connections (PostgreSQL only). Transactions
+   * wait for a free connection above this limit. 0 means unlimited.
+   */
+  std::size_t maxConnections = 0;
+
+  /**
+   * Number of connections kept open in the pool (PostgreSQL only).
+   */
+  std::size_t minConnections = 0;
+
+  /**
+   * True if every transaction on the connections is read-only. This is set
+   * once per connection so it doesn't cost a statement per transaction: by
+   * the startup options of the connections on PostgreSQL and by opening the
+   * database file read-only on SQLite.
+   */
+  bool readOnly = false;
+
+  /**
+   * Interval of logging the metrics of the database (see DatabaseMetrics).
+   * 0 means the metrics are not collected.
+   */
+  std::chrono::seconds metricsInterval{0};
+};
+
 /**
  * This function connects to and if required, optionally creates a database.
+ * A database is opened only once per connection string, so the options are
+ * applied at the first connection.
  * @param connStr_ The database connection string.
  * @param create_ True to create database if does not exist; otherwise, false.
+ * @param options_ Connection pool, read-only mode and metrics.
  */
 std::shared_ptr<odb::database> connectDatabase(
   const std::string& connStr_,
-  bool create_ = true);
+  bool create_ = true,
+  const DatabaseOptions& options_ = DatabaseOptions());
+
+/**
+ * This function executes a query which is prepared once per connection and
+ * reused by the later calls on the same connection, so the statement is not
+ * parsed and planned by the database again. The function has to be called in
+ * a transaction.
+ * @tparam T The type of the queried objects or view.
+ * @param name_ A unique name of the query. It has to be a string literal,
+ * since ODB stores the pointer.
+ * @param param_ The parameter of the query. The query is bound to a copy of
+ * it owned by the connection.
+ * @param makeQuery_ A function which returns the query for a reference to the
+ * parameter. The query has to bind the parameter by reference (odb::query::
+ * _ref()).
+ */
+template <typename T, typename Param, typename QueryFactory>
+odb::result<T> executePreparedQuery(
+  odb::database& db_,
+  const char* name_,
+  const Param& param_,
+  QueryFactory makeQuery_)
+{
+  odb::connection& conn = odb::transaction::current().connection();
+
+  Param* param;
+  odb::prepared_query<T> query = conn.lookup_query<T>(name_, param);
+
+  if (!query)
+  {
+    std::unique_ptr<Param> owned(new Param(param_));
+    param = owned.get();
+    query = db_.prepare_query<T>(name_, makeQuery_(*param));
+    conn.cache_query(query, std::move(owned));
+  }
+
+  *param = param_;
+  return query.execute();
+}
+
+/**
+ * The maximal number of values in an IN (...) list of a query. Longer lists
+ * are split by forEachChunk(), because the databases limit the number of bound
+ * parameters of a statement.
+ */
+constexpr std::size_t MAX_IN_LIST_SIZE = 500;
+
+/**
+ * This function calls func_ with the iterator ranges of the consecutive chunks
+ * of at most MAX_IN_LIST_SIZE elements of the given container, so that each
+ * chunk can be queried by an IN (...) list.
+ */
+template <typename Container, typename Function>
+void forEachChunk(const Container& container_, Function func_)
+{
+  auto it = container_.begin();
+
+  while (it != container_.end())
+  {
+    auto begin = it;
+    for (std::size_t i = 0;
+         i < MAX_IN_LIST_SIZE && it != container_.end();
+         ++i, ++it);
+
+    func_(begin, it);
+  }
+}
 
 /**
  * This function adds indexes to the database. These indexes are added from the
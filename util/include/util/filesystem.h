@@ -35,6 +35,20 @@ bool isRootedUnderAnyOf(
   const std::vector<std::string>& paths_,
   const std::string& path_);
 
+/**
+ * @brief Read the whole content of a file into a string.
+ *
+ * Regular files are memory mapped and copied into the result in one step.
+ * Files which can't be mapped (e.g. special files reporting zero size) are
+ * read in large blocks instead.
+ *
+ * @param path_ The path of the file to read.
+ * @param content_ The string which receives the file content. Its previous
+ * content is discarded.
+ * @return False if the file couldn't be opened or read, otherwise true.
+ */
+bool readFile(const std::string& path_, std::string& content_);
+
 } // namespace util
 } // namespace cc
 
@@ -31,14 +31,14 @@ inline std::uint64_t fnvHash(const std::string& data_)
   return hash;
 }
 
-inline std::string sha1Hash(const std::string& data_)
+inline std::string sha1Hash(const char* data_, std::size_t size_)
 {
   using namespace boost::uuids::detail;
 
   sha1 hasher;
   unsigned int digest[5];
 
-  hasher.process_bytes(data_.c_str(), data_.size());
+  hasher.process_bytes(data_, size_);
   hasher.get_digest(digest);
 
   std::stringstream ss;
@@ -52,6 +52,11 @@ inline std::string sha1Hash(const std::string& data_)
   return ss.str();
 }
 
+inline std::string sha1Hash(const std::string& data_)
+{
+  return sha1Hash(data_.c_str(), data_.size());
+}
+
 } // util
 } // cc
 
@@ -0,0 +1,179 @@
+#ifndef CC_UTIL_LRUCACHE_H
+#define CC_UTIL_LRUCACHE_H
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cc
+{
+namespace util
+{
+
+/**
+ * Thread safe, memory budgeted least recently used cache.
+ *
+ * The cache is split into shards by the hash of the key, each with its own
+ * mutex and its own share of the budget, so concurrent lookups of different
+ * keys rarely contend. The size of a value is given by a user supplied
+ * function, the cache evicts the least recently used values of a shard when
+ * the shard exceeds its budget.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache
+{
+public:
+  typedef std::function<std::size_t(const Value&)> SizeFunction;
+
+  struct Statistics
+  {
+    std::size_t hits;
+    std::size_t misses;
+    std::size_t evictions;
+    std::size_t entries;
+    std::size_t bytes;
+  };
+
+  LruCache(
+    std::size_t capacityBytes_,
+    SizeFunction sizeOf_,
+    std::size_t numShards_ = 16)
+      : _sizeOf(std::move(sizeOf_)),
+        _shards(numShards_),
+        _shardCapacity(capacityBytes_ / numShards_),
+        _hits(0), _misses(0), _evictions(0)
+  {
+    for (auto& shard : _shards)
+      shard.reset(new Shard());
+  }
+
+  LruCache(const LruCache&) = delete;
+  LruCache& operator=(const LruCache&) = delete;
+
+  /**
+   * This function looks up the value of the given key and marks it as the
+   * most recently used one.
+   * @return True if the key was found. In this case value_ is set.
+   */
+  bool get(const Key& key_, Value& value_)
+  {
+    Shard& shard = shardOf(key_);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(key_);
+    if (it == shard.index.end())
+    {
+      ++_misses;
+      return false;
+    }
+
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    value_ = it->second->value;
+
+    ++_hits;
+    return true;
+  }
+
+  /**
+   * This function inserts or replaces the value of the given key. A value
+   * larger than the budget of a shard is not stored.
+   */
+  void put(const Key& key_, Value value_)
+  {
+    std::size_t bytes = _sizeOf(value_);
+    if (bytes > _shardCapacity)
+      return;
+
+    Shard& shard = shardOf(key_);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(key_);
+    if (it != shard.index.end())
+    {
+      shard.bytes -= it->second->bytes;
+      shard.entries.erase(it->second);
+      shard.index.erase(it);
+    }
+
+    shard.entries.push_front(Entry{key_, std::move(value_), bytes});
+    shard.index.emplace(key_, shard.entries.begin());
+    shard.bytes += bytes;
+
+    while (shard.bytes > _shardCapacity)
+    {
+      const Entry& last = shard.entries.back();
+      shard.bytes -= last.bytes;
+      shard.index.erase(last.key);
+      shard.entries.pop_back();
+      ++_evictions;
+    }
+  }
+
+  /**
+   * Removes all elements from the cache. The counters are kept.
+   */
+  void clear()
+  {
+    for (auto& shard : _shards)
+    {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      shard->index.clear();
+      shard->entries.clear();
+      shard->bytes = 0;
+    }
+  }
+
+  Statistics statistics() const
+  {
+    Statistics stat{_hits, _misses, _evictions, 0, 0};
+
+    for (const auto& shard : _shards)
+    {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      stat.entries += shard->index.size();
+      stat.bytes += shard->bytes;
+    }
+
+    return stat;
+  }
+
+private:
+  struct Entry
+  {
+    Key key;
+    Value value;
+    std::size_t bytes;
+  };
+
+  struct Shard
+  {
+    std::list<Entry> entries;
+    std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index;
+    std::size_t bytes = 0;
+    mutable std::mutex mutex;
+  };
+
+  Shard& shardOf(const Key& key_)
+  {
+    return *_shards[_hasher(key_) % _shards.size()];
+  }
+
+  SizeFunction _sizeOf;
+  Hash _hasher;
+  std::vector<std::unique_ptr<Shard>> _shards;
+  std::size_t _shardCapacity;
+
+  std::atomic_size_t _hits;
+  std::atomic_size_t _misses;
+  std::atomic_size_t _evictions;
+};
+
+} // util
+} // cc
+
+#endif // CC_UTIL_LRUCACHE_H
@@ -1,6 +1,7 @@
 #ifndef CC_UTIL_ODBTRANSACTION_H
 #define CC_UTIL_ODBTRANSACTION_H
 
+#include <chrono>
 #include <memory>
 #include <future>
 #include <cstring>
@@ -10,6 +11,7 @@
 #include <odb/tracer.hxx>
 #include <odb/session.hxx>
 
+#include "dbmetrics.h"
 #include "logutil.h"
 
 namespace cc
@@ -79,6 +81,40 @@ namespace internal
     odb::session* _prevSession;
     odb::transaction* _prevTrans;
   };
+
+  /**
+   * Reports the end of a transaction to the metrics of the database, even if
+   * the transaction is rolled back by an exception.
+   */
+  class TransMetrics
+  {
+  public:
+    TransMetrics() : _metrics(nullptr)
+    {
+    }
+
+    ~TransMetrics()
+    {
+      if (_metrics)
+        _metrics->transactionFinished(
+          std::chrono::steady_clock::now() - _started);
+    }
+
+    void started(
+      DatabaseMetrics* metrics_,
+      std::chrono::steady_clock::time_point begin_)
+    {
+      _metrics = metrics_;
+      _started = std::chrono::steady_clock::now();
+
+      if (_metrics)
+        _metrics->transactionStarted(_started - begin_);
+    }
+
+  private:
+    DatabaseMetrics* _metrics;
+    std::chrono::steady_clock::time_point _started;
+  };
 }
 
 class OdbTransaction
@@ -103,6 +139,7 @@ public:
   {
     using namespace odb;
 
+    internal::TransMetrics trMetrics;
     std::unique_ptr<session> s;
     std::unique_ptr<transaction> t;
     internal::TransRestore trRestore;
@@ -117,7 +154,12 @@ public:
 #endif
     {
       s = std::make_unique<session>(false);
+
+      // Beginning a transaction waits for a free connection of the pool.
+      std::chrono::steady_clock::time_point begin
+        = std::chrono::steady_clock::now();
       t = std::make_unique<transaction>(_db.begin(), false);
+      trMetrics.started(DatabaseMetrics::of(_db), begin);
 
       session::current(*s);
       transaction::current(*t);
@@ -196,6 +238,43 @@ void persistAll(Cont& cont_, std::shared_ptr<odb::database> db_)
   }
 }
 
+/**
+ * This function persists the objects of the container like persistAll(), but
+ * in batches if the build uses ODB bulk operations (WITH_ODB_BULK CMake
+ * option, which is accepted only for PostgreSQL). This saves a database
+ * round-trip per object. The persistent class has to be declared with the bulk
+ * pragma under ODB_BULK (see model::CppAstNode) and it must not have an
+ * auto-assigned id, because the bulk persist of those is backend-specific.
+ * Without bulk support the function falls back to persistAll() which reuses
+ * the same prepared statement for every object.
+ */
+template <typename Cont>
+void persistAllBulk(Cont& cont_, std::shared_ptr<odb::database> db_)
+{
+#if defined(ODB_BULK) && defined(DATABASE_PGSQL)
+  try
+  {
+    db_->persist(cont_.begin(), cont_.end());
+  }
+  catch (const odb::multiple_exceptions& ex)
+  {
+    for (const odb::multiple_exceptions::value_type& e : ex)
+    {
+      LOG(debug) << cont_[e.position()]->toString();
+      LOG(warning) << e.exception().what();
+    }
+
+    if (ex.fatal())
+    {
+      LOG(error) << ex.what() << std::endl;
+      throw;
+    }
+  }
+#else
+  persistAll(cont_, db_);
+#endif
+}
+
 } // util
 } // cc
 
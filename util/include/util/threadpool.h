@@ -2,11 +2,18 @@
 #define CC_UTIL_THREADPOOL_H
 
 #include <atomic>
-#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/optional.hpp>
 
 namespace cc
 {
@@ -17,6 +24,11 @@ namespace util
  * @brief A simple thread pool iterating a list of jobs. This is a base class
  * to support overloading based on whether or not we want actual multithreading.
  *
+ * Job objects are moved through the pool, and the job function is called
+ * with the stored job as an lvalue. So move-only JobData types are supported
+ * if the client code moves them into enqueue() or submit() and the job
+ * function takes them by reference.
+ *
  * @tparam JobData    Jobs are represented in a custom, user-defined structure.
  */
 template <typename JobData>
@@ -36,6 +48,17 @@ public:
    */
   virtual void enqueue(JobData jobInfo) = 0;
 
+  /**
+   * @brief Enqueue a new job and get notified about its completion.
+   *
+   * @warning Job execution might start immediately at submit's return!
+   *
+   * @param jobInfo  The job object to work on.
+   * @return A future which becomes ready when the job has been executed. If
+   * the job function throws then the exception is stored in the future.
+   */
+  virtual std::future<void> submit(JobData jobInfo) = 0;
+
   /**
    * @brief Notify all workers to exit after doing the remaining work
    * and wait for the threads to die.
@@ -78,6 +101,29 @@ public:
     _func(jobInfo_);
   }
 
+  /**
+   * @brief Execute the thread pool's function on the given job. The returned
+   * future is already ready.
+   *
+   * @param jobInfo  The job object to work on.
+   */
+  std::future<void> submit(JobData jobInfo_)
+  {
+    std::promise<void> promise;
+
+    try
+    {
+      _func(jobInfo_);
+      promise.set_value();
+    }
+    catch (...)
+    {
+      promise.set_exception(std::current_exception());
+    }
+
+    return promise.get_future();
+  }
+
   /**
    * @brief Has no effect in single-threaded operation as enqueue()
    * automatically runs the job function.
@@ -93,11 +139,14 @@ private:
 };
 
 /**
- * @brief A simple thread pool which iterates a set of jobs dynamically.
+ * @brief A work-stealing thread pool which iterates a set of jobs dynamically.
  *
- * This class creates N worker threads in the background which are waken up
- * as jobs are added to the queue. Each worker takes a single job and executes
- * it, and the threads return to sleep.
+ * This class creates N worker threads in the background. Every worker owns a
+ * deque of jobs. Jobs enqueued by a worker of the pool go to its own deque,
+ * other jobs are distributed among the deques in a round-robin fashion. A
+ * worker takes jobs from the front of its own deque, and when that is empty it
+ * steals from the back of the others' deques. Workers only go to sleep when
+ * the whole pool is out of jobs and they are woken up by the next enqueue().
  *
  * @tparam JobData   Jobs are represented in a custom, user-defined structure.
  * @tparam Function  A user defined functor which the workers call to do the
@@ -115,12 +164,17 @@ public:
    * @param func         The function to execute on the enqueued jobs.
    */
   PooledJobQueue(size_t threadCount_, Function func_)
-    : _threadCount(threadCount_), _die(false)
+    : _threadCount(threadCount_ ? threadCount_ : 1),
+      _queues(_threadCount),
+      _nextQueue(0),
+      _pending(0),
+      _sleeping(0),
+      _die(false)
   {
-    for (size_t i = 0; i < threadCount_; ++i)
+    for (size_t i = 0; i < _threadCount; ++i)
       _threads.emplace_back(std::thread(
         &PooledJobQueue<JobData, Function>::worker,
-        this, func_));
+        this, i, func_));
   }
 
   ~PooledJobQueue()
@@ -138,12 +192,25 @@ public:
    */
   void enqueue(JobData jobInfo_)
   {
-    {
-      std::lock_guard<std::mutex> lock(_lock);
-      _queue.push(jobInfo_);
-    }
+    push(Task{std::move(jobInfo_), nullptr});
+  }
+
+  /**
+   * @brief Enqueue a new job to be executed by the thread pool and return a
+   * future which becomes ready when the job is done.
+   *
+   * @warning Job execution might start immediately at submit's return!
+   *
+   * @param jobInfo  The job object to work on.
+   */
+  std::future<void> submit(JobData jobInfo_)
+  {
+    auto promise = std::make_unique<std::promise<void>>();
+    std::future<void> future = promise->get_future();
+
+    push(Task{std::move(jobInfo_), std::move(promise)});
 
-    _signal.notify_one();
+    return future;
   }
 
   /**
@@ -152,75 +219,216 @@ public:
    */
   void wait()
   {
-    _die = true;
+    {
+      std::lock_guard<std::mutex> lock(_sleepLock);
+      _die = true;
+    }
+
     _signal.notify_all();
 
     for (std::thread& t : _threads)
-    {
-      // Keep nudging the threads so that the t.join() don't grind the
-      // system to a halt.
-      _signal.notify_all();
       if (t.joinable())
         t.join();
-    }
   }
 
 private:
+  /**
+   * A job in the queue. The promise is only set for jobs which were given to
+   * submit().
+   */
+  struct Task
+  {
+    JobData job;
+    std::unique_ptr<std::promise<void>> promise;
+  };
+
+  /**
+   * The job deque of a worker thread.
+   */
+  struct WorkerQueue
+  {
+    std::mutex lock;
+    std::deque<Task> tasks;
+
+    /**
+     * The size of the deque, readable without locking. This lets the thieves
+     * skip empty deques without contending on their locks.
+     */
+    std::atomic_size_t size{0};
+  };
+
+  /**
+   * @brief Place a task in one of the deques and wake up a sleeping worker if
+   * there is any.
+   */
+  void push(Task task_)
+  {
+    size_t index = _currentPool == this
+      ? _currentWorker
+      : _nextQueue.fetch_add(1, std::memory_order_relaxed) % _threadCount;
+
+    {
+      WorkerQueue& queue = _queues[index];
+      std::lock_guard<std::mutex> lock(queue.lock);
+      queue.tasks.push_back(std::move(task_));
+      ++queue.size;
+      ++_pending;
+    }
+
+    // A worker increments _sleeping before it checks _pending under
+    // _sleepLock, so either it sees the new job or we see it sleeping.
+    if (_sleeping > 0)
+    {
+      std::lock_guard<std::mutex> lock(_sleepLock);
+      _signal.notify_one();
+    }
+  }
+
+  /**
+   * @brief Take a task from the front of the worker's own deque or steal one
+   * from the back of another worker's deque.
+   * @return The task or boost::none if all deques are empty.
+   */
+  boost::optional<Task> pop(size_t index_)
+  {
+    for (size_t i = 0; i < _threadCount; ++i)
+    {
+      WorkerQueue& queue = _queues[(index_ + i) % _threadCount];
+
+      if (queue.size.load(std::memory_order_relaxed) == 0)
+        continue;
+
+      std::lock_guard<std::mutex> lock(queue.lock);
+
+      if (queue.tasks.empty())
+        continue;
+
+      boost::optional<Task> task;
+
+      if (i == 0)
+      {
+        task.emplace(std::move(queue.tasks.front()));
+        queue.tasks.pop_front();
+      }
+      else
+      {
+        task.emplace(std::move(queue.tasks.back()));
+        queue.tasks.pop_back();
+      }
+
+      --queue.size;
+      --_pending;
+      return task;
+    }
+
+    return boost::none;
+  }
+
   /**
    * @brief The worker method loops and waits for jobs to come and executes
    * function on them.
    */
-  void worker(Function function_)
+  void worker(size_t index_, Function function_)
   {
-    while (!(_die && _queue.empty()))  // The race condition here is known and
-                                       // allowed deliberately.
+    _currentPool = this;
+    _currentWorker = index_;
+
+    size_t idleRounds = 0;
+
+    while (true)
     {
-      // Lock on the mutex so that the queue access is safe.
-      std::unique_lock<std::mutex> lock(_lock);
-      if (_queue.empty())
+      boost::optional<Task> task = pop(index_);
+
+      if (task)
       {
-        // If the queue is empty, we have to wait for new work to be enqueued.
-        // The thread is randomly woken up from time to time to ensure that
-        // work is being done, even if an enqueue() call could not notify
-        // any thread, because noone was waiting.
-        _signal.wait_for(lock, std::chrono::seconds(1), [this]()
+        idleRounds = 0;
+
+        if (!task->promise)
         {
-          return !_queue.empty();
-        });
+          function_(task->job);
+          continue;
+        }
 
-        // Signal hit: work has been given to us, lock is reacquired.
-        // Release the lock and notify other thread that we will be working.
-        lock.unlock();
-        _signal.notify_one();
+        try
+        {
+          function_(task->job);
+          task->promise->set_value();
+        }
+        catch (...)
+        {
+          task->promise->set_exception(std::current_exception());
+        }
 
-        continue; // Next cycle will take the work if noone snatches it from us.
+        continue;
       }
-      else
+
+      // There is no job in any of the deques. Give the producers a chance
+      // before going to sleep, because waking up a thread is expensive.
+      if (idleRounds++ < MAX_IDLE_ROUNDS)
       {
-        // The queue was not empty, we can do actual work.
-        JobData job = _queue.front();
-        _queue.pop();
+        std::this_thread::yield();
+        continue;
+      }
 
-        // After popping, we are out of the critical section.
-        // Give the lock back and signal another thread.
-        lock.unlock();
-        _signal.notify_one();
+      idleRounds = 0;
 
-        // Do work.
-        function_(job);
-      }
+      // We have to wait for new work to be enqueued.
+      std::unique_lock<std::mutex> lock(_sleepLock);
+
+      ++_sleeping;
+      _signal.wait(lock, [this]() { return _pending > 0 || _die; });
+      --_sleeping;
+
+      if (_die && _pending == 0)
+        break;
     }
+
+    _currentPool = nullptr;
   }
 
+  /**
+   * The number of times an idle worker looks for jobs again before it goes to
+   * sleep.
+   */
+  static constexpr size_t MAX_IDLE_ROUNDS = 16;
+
+  /**
+   * The pool and the deque index of the worker running on the current thread.
+   * These are used for placing the jobs enqueued by a job in the deque of its
+   * own worker.
+   */
+  static thread_local PooledJobQueue* _currentPool;
+  static thread_local size_t _currentWorker;
+
   /**
    * The number of worker threads created when the class is instantiated.
    */
   const size_t _threadCount;
 
   /**
-   * std::mutex for accessing the _queue.
+   * The deques of the workers, indexed by the worker number.
+   */
+  std::vector<WorkerQueue> _queues;
+
+  /**
+   * Round-robin counter for distributing jobs enqueued by other threads.
    */
-  std::mutex _lock;
+  std::atomic_size_t _nextQueue;
+
+  /**
+   * The number of jobs in all deques.
+   */
+  std::atomic_size_t _pending;
+
+  /**
+   * The number of workers waiting on _signal.
+   */
+  std::atomic_size_t _sleeping;
+
+  /**
+   * std::mutex for sleeping on _signal.
+   */
+  std::mutex _sleepLock;
 
   /**
    * Condition variable to wake up worker threads.
@@ -233,18 +441,19 @@ private:
    */
   std::atomic_bool _die;
 
-  /**
-   * The queue contains the JobData objects which define the jobs the pool
-   * executes.
-   */
-  std::queue<JobData> _queue;
-
   /**
    * Contains the worker threads.
    */
   std::vector<std::thread> _threads;
 };
 
+template <typename JobData, typename Function>
+thread_local PooledJobQueue<JobData, Function>*
+PooledJobQueue<JobData, Function>::_currentPool = nullptr;
+
+template <typename JobData, typename Function>
+thread_local size_t PooledJobQueue<JobData, Function>::_currentWorker = 0;
+
 /**
  * @brief Create an std::unique_ptr for a thread pool with the given number of
  * threads.
@@ -1,6 +1,10 @@
 #ifndef CC_WEBSERVER_UTIL_H
 #define CC_WEBSERVER_UTIL_H
 
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include <map>
 #include <stdexcept>
@@ -19,6 +23,95 @@ public:
   }
 };
 
+namespace detail
+{
+
+/**
+ * Calls func_ with the trimmed elements of a comma separated HTTP header
+ * value until it returns true.
+ * @return True if func_ returned true for an element.
+ */
+template <typename F>
+bool anyHeaderElement(const char* header_, F func_)
+{
+  const char* end = header_ + std::strlen(header_);
+
+  while (header_ < end)
+  {
+    const char* comma = std::find(header_, end, ',');
+
+    const char* first = header_;
+    const char* last = comma;
+
+    while (first < last && std::isspace(*first))
+      ++first;
+    while (first < last && std::isspace(*(last - 1)))
+      --last;
+
+    if (first < last && func_(std::string(first, last)))
+      return true;
+
+    header_ = comma + (comma < end);
+  }
+
+  return false;
+}
+
+}
+
+/**
+ * This function checks whether the value of an Accept-Encoding header allows
+ * the given content coding, e.g. "gzip". Codings with zero quality value are
+ * not accepted.
+ */
+inline bool acceptsEncoding(const char* acceptEncoding_, const char* coding_)
+{
+  if (!acceptEncoding_)
+    return false;
+
+  return detail::anyHeaderElement(acceptEncoding_,
+    [coding_](const std::string& element_)
+    {
+      std::size_t semicolon = element_.find(';');
+      std::string coding = element_.substr(0, semicolon);
+
+      coding.erase(coding.find_last_not_of(" \t") + 1);
+
+      if (coding.size() != std::strlen(coding_) ||
+          !std::equal(coding.begin(), coding.end(), coding_,
+            [](char a_, char b_) {
+              return std::tolower(a_) == std::tolower(b_);
+            }))
+        return false;
+
+      if (semicolon == std::string::npos)
+        return true;
+
+      std::size_t q = element_.find("q=", semicolon);
+      return q == std::string::npos || std::atof(element_.c_str() + q + 2) > 0;
+    });
+}
+
+/**
+ * This function checks whether the value of an If-None-Match header matches
+ * the given strong entity tag, which contains the quotation marks. The header
+ * is compared weakly (RFC 9110 13.1.2), so a weak tag (W/"...") of the header
+ * matches too.
+ */
+inline bool matchesEntityTag(const char* ifNoneMatch_, const std::string& etag_)
+{
+  if (!ifNoneMatch_)
+    return false;
+
+  return detail::anyHeaderElement(ifNoneMatch_,
+    [&etag_](const std::string& element_)
+    {
+      return element_ == "*" || element_ == etag_ ||
+        (element_.compare(0, 2, "W/") == 0 &&
+         element_.compare(2, std::string::npos, etag_) == 0);
+    });
+}
+
 }
 }
 
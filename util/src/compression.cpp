@@ -0,0 +1,45 @@
+#include <limits>
+
+#include <zlib.h>
+
+#include <util/compression.h>
+
+namespace cc
+{
+namespace util
+{
+
+bool gzipCompress(
+  const char* data_,
+  std::size_t size_,
+  std::string& result_,
+  int level_)
+{
+  z_stream stream{};
+
+  if (size_ > std::numeric_limits<uInt>::max())
+    return false;
+
+  // 15 is the largest window size, +16 selects the gzip wrapper instead of
+  // the zlib one.
+  if (deflateInit2(&stream, level_, Z_DEFLATED, 15 + 16, 8,
+      Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+
+  result_.resize(deflateBound(&stream, size_));
+
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data_));
+  stream.avail_in = size_;
+  stream.next_out = reinterpret_cast<Bytef*>(&result_[0]);
+  stream.avail_out = result_.size();
+
+  int status = deflate(&stream, Z_FINISH);
+
+  result_.resize(stream.total_out);
+  deflateEnd(&stream);
+
+  return status == Z_STREAM_END;
+}
+
+}
+}
@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include <util/dbmetrics.h>
+#include <util/logutil.h>
+
+namespace
+{
+
+typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+double toMilliseconds(cc::util::DatabaseMetrics::Duration duration_)
+{
+  return std::chrono::duration_cast<Milliseconds>(duration_).count();
+}
+
+/**
+ * The statement being executed on the current thread. Statements are measured
+ * only inside the transactions reported to DatabaseMetrics, so the ones of
+ * other transactions (e.g. the test transaction of connectDatabase()) are not
+ * left open.
+ */
+struct CurrentStatement
+{
+  int transactions = 0;
+  cc::util::DatabaseMetrics* metrics = nullptr;
+  std::string text;
+  std::chrono::steady_clock::time_point start;
+};
+
+thread_local CurrentStatement currentStatement;
+
+std::atomic_size_t nextMetricsId(0);
+
+template <typename T>
+void updateMax(std::atomic<T>& max_, T value_)
+{
+  T max = max_;
+  while (value_ > max && !max_.compare_exchange_weak(max, value_));
+}
+
+}
+
+namespace cc
+{
+namespace util
+{
+
+constexpr std::size_t DatabaseMetrics::MAX_STATEMENTS;
+constexpr std::size_t DatabaseMetrics::NUM_SLOWEST_STATEMENTS;
+constexpr std::size_t DatabaseMetrics::MAX_LOGGED_STATEMENT_LENGTH;
+
+DatabaseMetrics::DatabaseMetrics(
+  std::string name_,
+  std::chrono::seconds logInterval_)
+  : _name(std::move(name_)),
+    _logInterval(logInterval_),
+    _id(nextMetricsId++),
+    _active(0),
+    _maxActive(0),
+    _lastLog(std::chrono::steady_clock::now())
+{
+  _nextLog = (_lastLog + _logInterval).time_since_epoch().count();
+}
+
+DatabaseMetrics* DatabaseMetrics::of(odb::database& db_)
+{
+  return dynamic_cast<DatabaseMetrics*>(db_.tracer());
+}
+
+void DatabaseMetrics::transactionStarted(Duration poolWait_)
+{
+  finishStatement(std::chrono::steady_clock::now());
+  ++currentStatement.transactions;
+
+  updateMax(_maxActive, ++_active);
+
+  Shard& stats = shard();
+  std::lock_guard<std::mutex> lock(stats.mutex);
+
+  stats.totalPoolWait += poolWait_;
+  stats.maxPoolWait = std::max(stats.maxPoolWait, poolWait_);
+}
+
+void DatabaseMetrics::transactionFinished(Duration duration_)
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+  finishStatement(now);
+  --currentStatement.transactions;
+  --_active;
+
+  {
+    Shard& stats = shard();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+
+    ++stats.transactions;
+    stats.totalTransactionTime += duration_;
+    stats.maxTransactionTime = std::max(stats.maxTransactionTime, duration_);
+  }
+
+  if (now.time_since_epoch().count() < _nextLog)
+    return;
+
+  // If another thread is logging the summary then this one doesn't wait.
+  std::unique_lock<std::mutex> lock(_mutex, std::try_to_lock);
+
+  if (lock.owns_lock() && now - _lastLog >= _logInterval)
+    logSummary(now);
+}
+
+void DatabaseMetrics::execute(odb::connection&, const char* statement_)
+{
+  if (currentStatement.transactions <= 0)
+    return;
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+  finishStatement(now);
+
+  currentStatement.metrics = this;
+  currentStatement.text = statement_;
+  currentStatement.start = now;
+}
+
+void DatabaseMetrics::finishStatement(
+  std::chrono::steady_clock::time_point now_)
+{
+  if (!currentStatement.metrics)
+    return;
+
+  currentStatement.metrics->recordStatement(
+    currentStatement.text, now_ - currentStatement.start);
+  currentStatement.metrics = nullptr;
+}
+
+DatabaseMetrics::Shard& DatabaseMetrics::shard()
+{
+  thread_local std::unordered_map<std::size_t, std::shared_ptr<Shard>> shards;
+
+  std::shared_ptr<Shard>& shard = shards[_id];
+
+  if (!shard)
+  {
+    shard = std::make_shared<Shard>();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _shards.push_back(shard);
+  }
+
+  return *shard;
+}
+
+void DatabaseMetrics::recordStatement(
+  const std::string& statement_,
+  Duration duration_)
+{
+  Shard& stats = shard();
+  std::lock_guard<std::mutex> lock(stats.mutex);
+
+  auto it = stats.statements.find(statement_);
+
+  if (it == stats.statements.end())
+  {
+    if (stats.statements.size() >= MAX_STATEMENTS)
+      return;
+
+    it = stats.statements.emplace(statement_, StatementStatistics()).first;
+  }
+
+  ++it->second.count;
+  it->second.total += duration_;
+  it->second.max = std::max(it->second.max, duration_);
+}
+
+void DatabaseMetrics::logSummary(std::chrono::steady_clock::time_point now_)
+{
+  std::chrono::seconds elapsed
+    = std::chrono::duration_cast<std::chrono::seconds>(now_ - _lastLog);
+
+  _lastLog = now_;
+  _nextLog = (now_ + _logInterval).time_since_epoch().count();
+
+  //--- Merge the shards ---//
+
+  std::size_t transactions = 0;
+  Duration totalPoolWait(0);
+  Duration maxPoolWait(0);
+  Duration totalTransactionTime(0);
+  Duration maxTransactionTime(0);
+  std::unordered_map<std::string, StatementStatistics> statements;
+
+  for (const std::shared_ptr<Shard>& shard : _shards)
+  {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+
+    transactions += shard->transactions;
+    totalPoolWait += shard->totalPoolWait;
+    maxPoolWait = std::max(maxPoolWait, shard->maxPoolWait);
+    totalTransactionTime += shard->totalTransactionTime;
+    maxTransactionTime
+      = std::max(maxTransactionTime, shard->maxTransactionTime);
+
+    for (const auto& stat : shard->statements)
+    {
+      StatementStatistics& merged = statements[stat.first];
+      merged.count += stat.second.count;
+      merged.total += stat.second.total;
+      merged.max = std::max(merged.max, stat.second.max);
+    }
+
+    shard->transactions = 0;
+    shard->totalPoolWait = shard->maxPoolWait = Duration(0);
+    shard->totalTransactionTime = shard->maxTransactionTime = Duration(0);
+    shard->statements.clear();
+  }
+
+  // The shards of the exited threads are referenced only by this object.
+  _shards.erase(
+    std::remove_if(_shards.begin(), _shards.end(),
+      [](const std::shared_ptr<Shard>& shard_)
+      {
+        return shard_.use_count() == 1;
+      }),
+    _shards.end());
+
+  int maxActive = _maxActive.exchange(_active);
+
+  if (transactions == 0)
+    return;
+
+  std::vector<std::pair<std::string, StatementStatistics>> slowest(
+    statements.begin(), statements.end());
+
+  std::size_t numSlowest = std::min(slowest.size(), NUM_SLOWEST_STATEMENTS);
+
+  std::partial_sort(
+    slowest.begin(), slowest.begin() + numSlowest, slowest.end(),
+    [](const std::pair<std::string, StatementStatistics>& lhs_,
+       const std::pair<std::string, StatementStatistics>& rhs_)
+    {
+      return lhs_.second.max > rhs_.second.max;
+    });
+
+  std::ostringstream summary;
+  summary
+    << "[db] " << _name << ": " << transactions << " transaction(s) in "
+    << elapsed.count() << " s, " << _active << " active (max "
+    << maxActive << "), pool wait avg "
+    << toMilliseconds(totalPoolWait) / transactions << " ms, max "
+    << toMilliseconds(maxPoolWait) << " ms, transaction avg "
+    << toMilliseconds(totalTransactionTime) / transactions << " ms, max "
+    << toMilliseconds(maxTransactionTime) << " ms";
+
+  for (std::size_t i = 0; i < numSlowest; ++i)
+  {
+    const StatementStatistics& stat = slowest[i].second;
+
+    summary
+      << "\n  " << toMilliseconds(stat.max) << " ms max, "
+      << toMilliseconds(stat.total) / stat.count << " ms avg, "
+      << stat.count << "x: "
+      << slowest[i].first.substr(0, MAX_LOGGED_STATEMENT_LENGTH);
+  }
+
+  LOG(info) << summary.str();
+}
+
+} // util
+} // cc
@@ -13,12 +13,14 @@
 #endif
 
 #ifdef DATABASE_PGSQL
+#  include <odb/pgsql/connection-factory.hxx>
 #  include <odb/pgsql/database.hxx>
 #endif
 
 #include <odb/connection.hxx>
 
 #include <util/logutil.h>
+#include <util/dbmetrics.h>
 #include <util/dbutil.h>
 
 namespace
@@ -290,9 +292,16 @@ namespace util
  */
 static std::map<std::string, std::shared_ptr<odb::database>> databasePool;
 
+/**
+ * Connection string -> metrics of the databases in databasePool. The metrics
+ * have to live as long as the databases.
+ */
+static std::map<std::string, std::unique_ptr<DatabaseMetrics>> databaseMetrics;
+
 std::shared_ptr<odb::database> connectDatabase(
   const std::string& connStr_,
-  bool create_)
+  bool create_,
+  const DatabaseOptions& options_)
 {
   auto iter = databasePool.find(connStr_);
   if (iter != databasePool.end())
@@ -325,13 +334,19 @@ std::shared_ptr<odb::database> connectDatabase(
 #ifdef DATABASE_SQLITE
   if (database == "sqlite")
   {
+    // The read-only mode is a flag of opening the database, so it applies to
+    // every connection of the factory, not only to the first one.
+    int flags = options_.readOnly
+      ? SQLITE_OPEN_READONLY
+      : SQLITE_OPEN_READWRITE | (create_ ? SQLITE_OPEN_CREATE : 0);
+
     try
     {
       auto sqliteDB = new odb::sqlite::database(
         optionsSize,
         cStyleOptions,
         false,
-        SQLITE_OPEN_READWRITE | (create_ ? SQLITE_OPEN_CREATE : 0),
+        flags,
         true,
         "",
         std::make_unique<odb::sqlite::single_connection_factory>());
@@ -365,8 +380,18 @@ std::shared_ptr<odb::database> connectDatabase(
 
     if (checkPsqlDatbase(defaultPsqlConnStr, dbName, create_))
     {
-      db.reset(new odb::pgsql::database(optionsSize, cStyleOptions),
-               [](odb::database*) {});
+      // The read-only mode is set by the startup options of the connection,
+      // so it doesn't need a SET TRANSACTION statement per transaction.
+      db.reset(new odb::pgsql::database(
+          optionsSize,
+          cStyleOptions,
+          false,
+          options_.readOnly
+            ? "options='-c default_transaction_read_only=on'"
+            : "",
+          std::make_unique<odb::pgsql::connection_pool_factory>(
+            options_.maxConnections, options_.minConnections)),
+        [](odb::database*) {});
     }
     else
     {
@@ -398,6 +423,16 @@ std::shared_ptr<odb::database> connectDatabase(
     db->connection()->execute("PRAGMA case_sensitive_like = ON");
 #endif
 
+  if (options_.metricsInterval.count() > 0)
+  {
+    std::string name = connStrComponent(connStr_, "database");
+
+    std::unique_ptr<DatabaseMetrics>& metrics = databaseMetrics[connStr_];
+    metrics.reset(new DatabaseMetrics(
+      name.empty() ? database : name, options_.metricsInterval));
+    db->tracer(*metrics);
+  }
+
   databasePool[connStr_] = db;
 
   return db;
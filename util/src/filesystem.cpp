@@ -1,5 +1,9 @@
+#include <cerrno>
 #include <cstdlib>
 #include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <boost/filesystem.hpp>
@@ -75,5 +79,52 @@ bool isRootedUnderAnyOf(
   return it != end;
 }
 
+bool readFile(const std::string& path_, std::string& content_)
+{
+  int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  content_.clear();
+
+  struct stat st;
+  if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+  {
+    std::size_t size = static_cast<std::size_t>(st.st_size);
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data != MAP_FAILED)
+    {
+      ::madvise(data, size, MADV_SEQUENTIAL);
+      content_.assign(static_cast<const char*>(data), size);
+      ::munmap(data, size);
+      ::close(fd);
+      return true;
+    }
+  }
+
+  // Fall back to block reads if the file can't be mapped.
+  constexpr std::size_t blockSize = 1 << 20;
+  std::size_t size = 0;
+
+  while (true)
+  {
+    content_.resize(size + blockSize);
+    ssize_t len = ::read(fd, &content_[size], blockSize);
+
+    if (len < 0 && errno == EINTR)
+      continue;
+
+    if (len <= 0)
+    {
+      content_.resize(size);
+      ::close(fd);
+      return len == 0;
+    }
+
+    size += static_cast<std::size_t>(len);
+  }
+}
+
 } // namespace util
 } // namespace cc
@@ -0,0 +1,143 @@
+#define GTEST_HAS_TR1_TUPLE 1
+#define GTEST_USE_OWN_TR1_TUPLE 0
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <util/lrucache.h>
+
+using namespace cc;
+
+namespace
+{
+
+/**
+ * The size of a value is its length, so the tests can count the budget in
+ * characters. The caches have a single shard, which gets the whole budget.
+ */
+typedef util::LruCache<int, std::string> Cache;
+
+std::size_t length(const std::string& value_)
+{
+  return value_.size();
+}
+
+bool contains(Cache& cache_, int key_)
+{
+  std::string value;
+  return cache_.get(key_, value);
+}
+
+}
+
+TEST(LruCacheTest, FindsStoredValues)
+{
+  Cache cache(100, length, 1);
+  cache.put(1, "one");
+  cache.put(2, "two");
+
+  std::string value;
+  ASSERT_TRUE(cache.get(1, value));
+  EXPECT_EQ("one", value);
+  ASSERT_TRUE(cache.get(2, value));
+  EXPECT_EQ("two", value);
+  EXPECT_FALSE(cache.get(3, value));
+
+  Cache::Statistics stat = cache.statistics();
+  EXPECT_EQ(2u, stat.hits);
+  EXPECT_EQ(1u, stat.misses);
+  EXPECT_EQ(2u, stat.entries);
+  EXPECT_EQ(6u, stat.bytes);
+}
+
+TEST(LruCacheTest, EvictsLeastRecentlyUsedValue)
+{
+  Cache cache(9, length, 1);
+  cache.put(1, "aaa");
+  cache.put(2, "bbb");
+  cache.put(3, "ccc");
+
+  // Using the oldest value makes the second one the least recently used.
+  EXPECT_TRUE(contains(cache, 1));
+
+  cache.put(4, "ddd");
+
+  EXPECT_TRUE(contains(cache, 1));
+  EXPECT_FALSE(contains(cache, 2));
+  EXPECT_TRUE(contains(cache, 3));
+  EXPECT_TRUE(contains(cache, 4));
+  EXPECT_EQ(1u, cache.statistics().evictions);
+}
+
+TEST(LruCacheTest, EvictsUntilValuesFitInBudget)
+{
+  Cache cache(10, length, 1);
+  cache.put(1, "aa");
+  cache.put(2, "bb");
+  cache.put(3, "cc");
+  cache.put(4, "dddddddd");
+
+  // Two values have to be evicted to make room for the large one.
+  EXPECT_FALSE(contains(cache, 1));
+  EXPECT_FALSE(contains(cache, 2));
+  EXPECT_TRUE(contains(cache, 3));
+  EXPECT_TRUE(contains(cache, 4));
+
+  Cache::Statistics stat = cache.statistics();
+  EXPECT_EQ(2u, stat.evictions);
+  EXPECT_EQ(2u, stat.entries);
+  EXPECT_EQ(10u, stat.bytes);
+}
+
+TEST(LruCacheTest, DoesNotStoreValueLargerThanBudget)
+{
+  Cache cache(4, length, 1);
+  cache.put(1, "aaaa");
+  cache.put(2, "bbbbb");
+
+  EXPECT_TRUE(contains(cache, 1));
+  EXPECT_FALSE(contains(cache, 2));
+  EXPECT_EQ(0u, cache.statistics().evictions);
+}
+
+TEST(LruCacheTest, ReplacesValueOfExistingKey)
+{
+  Cache cache(10, length, 1);
+  cache.put(1, "aaa");
+  cache.put(2, "bbb");
+  cache.put(1, "xxxxx");
+
+  std::string value;
+  ASSERT_TRUE(cache.get(1, value));
+  EXPECT_EQ("xxxxx", value);
+
+  Cache::Statistics stat = cache.statistics();
+  EXPECT_EQ(2u, stat.entries);
+  EXPECT_EQ(8u, stat.bytes);
+
+  // The replaced value became the most recently used one, so the other key
+  // is evicted first.
+  cache.put(3, "ccc");
+
+  EXPECT_FALSE(contains(cache, 2));
+  EXPECT_TRUE(contains(cache, 1));
+  EXPECT_TRUE(contains(cache, 3));
+}
+
+TEST(LruCacheTest, ClearKeepsCounters)
+{
+  Cache cache(100, length, 4);
+  for (int i = 0; i < 10; ++i)
+    cache.put(i, "value");
+
+  EXPECT_TRUE(contains(cache, 5));
+  cache.clear();
+  EXPECT_FALSE(contains(cache, 5));
+
+  Cache::Statistics stat = cache.statistics();
+  EXPECT_EQ(0u, stat.entries);
+  EXPECT_EQ(0u, stat.bytes);
+  EXPECT_EQ(1u, stat.hits);
+  EXPECT_EQ(1u, stat.misses);
+}
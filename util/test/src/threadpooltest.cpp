@@ -0,0 +1,219 @@
+#define GTEST_HAS_TR1_TUPLE 1
+#define GTEST_USE_OWN_TR1_TUPLE 0
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+#include <util/threadpool.h>
+
+using namespace cc;
+
+namespace
+{
+
+/**
+ * Busy waits until the predicate holds or the timeout expires.
+ * @return The value of the predicate.
+ */
+template <typename Predicate>
+bool waitFor(Predicate pred_, std::chrono::seconds timeout_)
+{
+  auto deadline = std::chrono::steady_clock::now() + timeout_;
+
+  while (!pred_())
+  {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  return true;
+}
+
+}
+
+TEST(ThreadPoolTest, JobFunctionTakesReference)
+{
+  int sum = 0;
+  std::mutex lock;
+
+  auto pool = util::make_thread_pool<int>(4, [&](int& job_)
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      sum += job_;
+    });
+
+  for (int i = 1; i <= 100; ++i)
+    pool->enqueue(i);
+
+  pool->wait();
+
+  EXPECT_EQ(sum, 5050);
+}
+
+TEST(ThreadPoolTest, MoveOnlyJobs)
+{
+  std::atomic_int sum(0);
+
+  auto pool = util::make_thread_pool<std::unique_ptr<int>>(4,
+    [&](std::unique_ptr<int>& job_) { sum += *job_; });
+
+  for (int i = 1; i <= 100; ++i)
+    pool->enqueue(std::make_unique<int>(i));
+
+  pool->wait();
+
+  EXPECT_EQ(sum, 5050);
+}
+
+TEST(ThreadPoolTest, SubmitReturnsFuture)
+{
+  std::atomic_int done(0);
+
+  auto pool = util::make_thread_pool<int>(4, [&](int job_)
+    {
+      if (job_ < 0)
+        throw std::runtime_error("negative job");
+      ++done;
+    });
+
+  std::future<void> ok = pool->submit(1);
+  std::future<void> failed = pool->submit(-1);
+
+  ok.get();
+  EXPECT_EQ(done, 1);
+  EXPECT_THROW(failed.get(), std::runtime_error);
+
+  pool->wait();
+}
+
+TEST(ThreadPoolTest, SubmitOnSingleThreadIsSynchronous)
+{
+  int done = 0;
+
+  auto pool = util::make_thread_pool<int>(1, [&](int) { ++done; });
+
+  std::future<void> future = pool->submit(0);
+
+  EXPECT_EQ(done, 1);
+  EXPECT_EQ(future.wait_for(std::chrono::seconds(0)),
+    std::future_status::ready);
+}
+
+TEST(ThreadPoolTest, NestedEnqueue)
+{
+  // Every job of depth d enqueues two jobs of depth d + 1, so a tree of
+  // 2^(DEPTH + 1) - 1 jobs is executed.
+  constexpr int DEPTH = 10;
+
+  std::atomic_int executed(0);
+  util::JobQueueThreadPool<int>* pool = nullptr;
+
+  auto poolPtr = util::make_thread_pool<int>(4, [&](int depth_)
+    {
+      ++executed;
+
+      if (depth_ < DEPTH)
+      {
+        pool->enqueue(depth_ + 1);
+        pool->enqueue(depth_ + 1);
+      }
+    });
+
+  pool = poolPtr.get();
+  pool->enqueue(0);
+
+  // The jobs enqueued by running jobs have to be executed before wait()
+  // returns, even if the other workers have already exited.
+  pool->wait();
+
+  EXPECT_EQ(executed, (1 << (DEPTH + 1)) - 1);
+}
+
+TEST(ThreadPoolTest, IdleWorkersStealJobs)
+{
+  // The root job places its children in the deque of its own worker and
+  // blocks that worker until they are done, so they can only be executed by
+  // stealing them.
+  constexpr int CHILDREN = 16;
+
+  std::atomic_int children(0);
+  std::mutex lock;
+  std::set<std::thread::id> childThreads;
+  std::thread::id rootThread;
+  bool stolen = false;
+
+  util::JobQueueThreadPool<int>* pool = nullptr;
+
+  auto poolPtr = util::make_thread_pool<int>(4, [&](int job_)
+    {
+      if (job_ == 0)
+      {
+        rootThread = std::this_thread::get_id();
+
+        for (int i = 1; i <= CHILDREN; ++i)
+          pool->enqueue(i);
+
+        stolen = waitFor(
+          [&]() { return children == CHILDREN; },
+          std::chrono::seconds(30));
+        return;
+      }
+
+      std::lock_guard<std::mutex> guard(lock);
+      childThreads.insert(std::this_thread::get_id());
+      ++children;
+    });
+
+  pool = poolPtr.get();
+  pool->enqueue(0);
+  pool->wait();
+
+  EXPECT_TRUE(stolen);
+  EXPECT_EQ(children, CHILDREN);
+  EXPECT_EQ(childThreads.count(rootThread), 0u);
+}
+
+TEST(ThreadPoolTest, WaitDrainsQueue)
+{
+  constexpr int JOBS = 10000;
+
+  std::atomic_int executed(0);
+
+  auto pool = util::make_thread_pool<int>(8, [&](int) { ++executed; });
+
+  for (int i = 0; i < JOBS; ++i)
+    pool->enqueue(i);
+
+  pool->wait();
+
+  EXPECT_EQ(executed, JOBS);
+}
+
+TEST(ThreadPoolTest, DestructorDrainsQueue)
+{
+  constexpr int JOBS = 1000;
+
+  std::atomic_int executed(0);
+
+  {
+    auto pool = util::make_thread_pool<int>(4, [&](int)
+      {
+        std::this_thread::sleep_for(std::chrono::microseconds(10));
+        ++executed;
+      });
+
+    for (int i = 0; i < JOBS; ++i)
+      pool->enqueue(i);
+  }
+
+  EXPECT_EQ(executed, JOBS);
+}
@@ -0,0 +1,71 @@
+#define GTEST_HAS_TR1_TUPLE 1
+#define GTEST_USE_OWN_TR1_TUPLE 0
+
+#include <gtest/gtest.h>
+
+#include <util/webserverutil.h>
+
+using namespace cc;
+
+TEST(AcceptsEncodingTest, MissingHeaderAcceptsNothing)
+{
+  EXPECT_FALSE(util::acceptsEncoding(nullptr, "gzip"));
+  EXPECT_FALSE(util::acceptsEncoding("", "gzip"));
+}
+
+TEST(AcceptsEncodingTest, FindsCodingInList)
+{
+  EXPECT_TRUE(util::acceptsEncoding("gzip", "gzip"));
+  EXPECT_TRUE(util::acceptsEncoding("deflate, gzip, br", "gzip"));
+  EXPECT_TRUE(util::acceptsEncoding("  br ,gzip  ", "gzip"));
+  EXPECT_FALSE(util::acceptsEncoding("deflate, br", "gzip"));
+}
+
+TEST(AcceptsEncodingTest, ComparesWholeCodingCaseInsensitively)
+{
+  EXPECT_TRUE(util::acceptsEncoding("GZip", "gzip"));
+  EXPECT_FALSE(util::acceptsEncoding("x-gzip", "gzip"));
+  EXPECT_FALSE(util::acceptsEncoding("gzipped", "gzip"));
+  EXPECT_FALSE(util::acceptsEncoding("gzi", "gzip"));
+}
+
+TEST(AcceptsEncodingTest, RejectsCodingWithZeroQuality)
+{
+  EXPECT_TRUE(util::acceptsEncoding("gzip;q=0.5", "gzip"));
+  EXPECT_TRUE(util::acceptsEncoding("gzip ; q=1, br", "gzip"));
+  EXPECT_FALSE(util::acceptsEncoding("gzip;q=0", "gzip"));
+  EXPECT_FALSE(util::acceptsEncoding("br, gzip; q=0.000", "gzip"));
+}
+
+TEST(MatchesEntityTagTest, MissingHeaderMatchesNothing)
+{
+  EXPECT_FALSE(util::matchesEntityTag(nullptr, "\"abc\""));
+  EXPECT_FALSE(util::matchesEntityTag("", "\"abc\""));
+}
+
+TEST(MatchesEntityTagTest, FindsTagInList)
+{
+  EXPECT_TRUE(util::matchesEntityTag("\"abc\"", "\"abc\""));
+  EXPECT_TRUE(util::matchesEntityTag("\"xyz\", \"abc\"", "\"abc\""));
+  EXPECT_TRUE(util::matchesEntityTag(" \"abc\" ,\"xyz\"", "\"abc\""));
+  EXPECT_FALSE(util::matchesEntityTag("\"xyz\", \"abcd\"", "\"abc\""));
+}
+
+TEST(MatchesEntityTagTest, RequiresQuotationMarks)
+{
+  EXPECT_FALSE(util::matchesEntityTag("abc", "\"abc\""));
+  EXPECT_FALSE(util::matchesEntityTag("\"abc", "\"abc\""));
+}
+
+TEST(MatchesEntityTagTest, MatchesWeakTagsAndWildcard)
+{
+  EXPECT_TRUE(util::matchesEntityTag("W/\"abc\"", "\"abc\""));
+  EXPECT_FALSE(util::matchesEntityTag("W/\"xyz\"", "\"abc\""));
+  EXPECT_TRUE(util::matchesEntityTag("*", "\"abc\""));
+}
+
+TEST(MatchesEntityTagTest, DistinguishesCompressedRepresentation)
+{
+  EXPECT_FALSE(util::matchesEntityTag("\"abc-gzip\"", "\"abc\""));
+  EXPECT_TRUE(util::matchesEntityTag("\"abc-gzip\"", "\"abc-gzip\""));
+}
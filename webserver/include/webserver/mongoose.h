@@ -113,6 +113,13 @@ size_t mg_websocket_printf(struct mg_connection* conn, int opcode,
 
 void mg_send_file(struct mg_connection *, const char *path);
 
+// Serving a request on another thread
+struct mg_connection *mg_copy_request(struct mg_connection *);
+struct mg_connection *mg_create_subrequest(struct mg_connection *,
+                                           const char *content, size_t);
+const char *mg_get_buffered_reply(struct mg_connection *, size_t *len);
+void mg_destroy_request_copy(struct mg_connection *);
+
 const char *mg_get_header(const struct mg_connection *, const char *name);
 const char *mg_get_mime_type(const char *name, const char *default_mime_type);
 int mg_get_var(const struct mg_connection *conn, const char *var_name,
@@ -1,6 +1,7 @@
 #ifndef CC_WEBSERVER_PLUGINHELPER_H
 #define CC_WEBSERVER_PLUGINHELPER_H
 
+#include <chrono>
 #include <memory>
 
 #include <boost/filesystem.hpp>
@@ -33,6 +34,22 @@ inline void registerPluginSimple(
   namespace fs = boost::filesystem;
   namespace pt = boost::property_tree;
 
+  // The services only read the databases.
+  util::DatabaseOptions dbOptions;
+  dbOptions.readOnly = true;
+
+  if (ctx_.options.count("db-pool-max-connections"))
+    dbOptions.maxConnections
+      = ctx_.options["db-pool-max-connections"].as<std::size_t>();
+
+  if (ctx_.options.count("db-pool-min-connections"))
+    dbOptions.minConnections
+      = ctx_.options["db-pool-min-connections"].as<std::size_t>();
+
+  if (ctx_.options.count("db-metrics-interval"))
+    dbOptions.metricsInterval = std::chrono::seconds(
+      ctx_.options["db-metrics-interval"].as<int>());
+
   for (fs::directory_iterator it(ctx_.options["workspace"].as<std::string>());
     it != fs::directory_iterator();
     ++it)
@@ -64,7 +81,8 @@ inline void registerPluginSimple(
       continue;
     }
 
-    std::shared_ptr<odb::database> db = util::connectDatabase(connStr);
+    std::shared_ptr<odb::database> db
+      = util::connectDatabase(connStr, true, dbOptions);
 
     if (!db)
     {
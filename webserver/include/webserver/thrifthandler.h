@@ -2,14 +2,22 @@
 #define CC_WEBSERVER_THRIFTHANDLER_H
 
 #include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <memory>
+#include <string>
 
 #include <thrift/transport/TBufferTransports.h>
 #include <thrift/transport/THttpServer.h>
 #include <thrift/transport/TTransport.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
 #include <thrift/protocol/TJSONProtocol.h>
 
+#include <util/compression.h>
 #include <util/logutil.h>
+#include <util/webserverutil.h>
 #include <webserver/requesthandler.h>
 
 #include "mongoose.h"
@@ -88,40 +96,93 @@ public:
 
     try
     {
-      std::string content{conn_->content, conn_->content + conn_->content_len};
+      Protocol protocol = negotiateProtocol(conn_);
 
-      LOG(debug) << "Request content:\n" << content;
+      if (protocol == Protocol::JSON)
+        LOG(debug) << "Request content:\n"
+          << std::string(
+               conn_->content,
+               std::min(conn_->content_len, MAX_LOGGED_CONTENT_LENGTH));
+      else
+        LOG(debug)
+          << "Request content: " << conn_->content_len << " bytes in "
+          << contentType(protocol);
 
-      std::shared_ptr<TTransport> inputBuffer(
-        new TMemoryBuffer((std::uint8_t*)content.c_str(), content.length()));
+      // The request body is read in place, it is owned by mongoose until the
+      // end of this function.
+      std::shared_ptr<TTransport> inputBuffer(new TMemoryBuffer(
+        reinterpret_cast<std::uint8_t*>(conn_->content),
+        static_cast<std::uint32_t>(conn_->content_len)));
 
-      std::shared_ptr<TTransport> outputBuffer(new TMemoryBuffer(4096));
+      // The output buffer starts with the size of the previous response, so
+      // large responses are not reallocated several times while they grow.
+      std::shared_ptr<TMemoryBuffer> outputBuffer(new TMemoryBuffer(
+        std::min(
+          std::max(_lastResponseSize.load(), MIN_OUTPUT_BUFFER_SIZE),
+          MAX_OUTPUT_BUFFER_SIZE)));
 
-      std::shared_ptr<TProtocol> inputProtocol(
-        new TJSONProtocol(inputBuffer));
-      std::shared_ptr<TProtocol> outputProtocol(
-        new TJSONProtocol(outputBuffer));
+      std::shared_ptr<TProtocol> inputProtocol
+        = createProtocol(protocol, inputBuffer);
+      std::shared_ptr<TProtocol> outputProtocol
+        = createProtocol(protocol, outputBuffer);
 
       CallContext ctx{conn_, nullptr};
       _processor.process(inputProtocol, outputProtocol, &ctx);
 
-      TMemoryBuffer *mBuffer = dynamic_cast<TMemoryBuffer*>(outputBuffer.get());
+      std::uint8_t* response;
+      std::uint32_t responseLength;
+      outputBuffer->getBuffer(&response, &responseLength);
 
-      std::string response = mBuffer->getBufferAsString();
+      _lastResponseSize = responseLength;
 
-      LOG(debug)
-        << "Response:\n" << response.c_str() << std::endl;
+      if (protocol == Protocol::JSON)
+        LOG(debug) << "Response:\n"
+          << std::string(
+               reinterpret_cast<const char*>(response),
+               std::min<std::size_t>(
+                 responseLength, MAX_LOGGED_CONTENT_LENGTH));
+      else
+        LOG(debug) << "Response: " << responseLength << " bytes";
+
+      // The calls are POST requests, so their responses are not cached and
+      // they have no entity tags, but they can be compressed.
+      bool compressible = responseLength >= MIN_COMPRESSED_RESPONSE_SIZE;
+
+      std::string compressed;
+      bool gzip = compressible &&
+        util::acceptsEncoding(
+          mg_get_header(conn_, "Accept-Encoding"), "gzip") &&
+        util::gzipCompress(
+          reinterpret_cast<const char*>(response), responseLength,
+          compressed) &&
+        compressed.size() < responseLength;
+
+      if (gzip)
+      {
+        LOG(debug) << "Response compressed to " << compressed.size()
+          << " bytes";
+
+        response = reinterpret_cast<std::uint8_t*>(&compressed[0]);
+        responseLength = compressed.size();
+      }
 
       // Send HTTP reply to the client create headers
-      mg_send_header(conn_, "Content-Type", "application/x-thrift");
+      mg_send_header(conn_, "Content-Type", contentType(protocol));
+
+      if (compressible)
+        mg_send_header(conn_, "Vary", "Accept-Encoding");
+
+      if (gzip)
+        mg_send_header(conn_, "Content-Encoding", "gzip");
+
       mg_send_header(
-        conn_, "Content-Length", std::to_string(response.length()).c_str());
+        conn_, "Content-Length", std::to_string(responseLength).c_str());
 
       // Terminate headers
       mg_write(conn_, "\r\n", 2);
 
       // Send content
-      mg_write(conn_, response.c_str(), response.length());
+      mg_write(conn_, response, responseLength);
     }
     catch (const std::exception& ex)
     {
@@ -138,9 +199,106 @@ public:
   }
 
 private:
+  /**
+   * The Thrift protocols which can be requested by the Content-Type header.
+   */
+  enum class Protocol
+  {
+    JSON,
+    Binary,
+    Compact
+  };
+
+  /**
+   * Bounds of the initial size of the output buffer.
+   */
+  static constexpr std::uint32_t MIN_OUTPUT_BUFFER_SIZE = 4096;
+  static constexpr std::uint32_t MAX_OUTPUT_BUFFER_SIZE = 1024 * 1024;
+
+  /**
+   * Smaller responses are not compressed, the saving would not be worth the
+   * time and the headers.
+   */
+  static constexpr std::uint32_t MIN_COMPRESSED_RESPONSE_SIZE = 1024;
+
+  /**
+   * The request and response bodies are logged up to this length.
+   */
+  static constexpr std::size_t MAX_LOGGED_CONTENT_LENGTH = 4096;
+
+  /**
+   * Selects the protocol by the Content-Type header of the request. The web
+   * frontend uses JSON, which is the default.
+   */
+  static Protocol negotiateProtocol(struct mg_connection* conn_)
+  {
+    const char* type = mg_get_header(conn_, "Content-Type");
+
+    if (!type)
+      return Protocol::JSON;
+
+    if (std::strstr(type, "application/vnd.apache.thrift.binary"))
+      return Protocol::Binary;
+
+    if (std::strstr(type, "application/vnd.apache.thrift.compact"))
+      return Protocol::Compact;
+
+    return Protocol::JSON;
+  }
+
+  static const char* contentType(Protocol protocol_)
+  {
+    switch (protocol_)
+    {
+      case Protocol::Binary:
+        return "application/vnd.apache.thrift.binary";
+      case Protocol::Compact:
+        return "application/vnd.apache.thrift.compact";
+      case Protocol::JSON:
+      default:
+        return "application/x-thrift";
+    }
+  }
+
+  static std::shared_ptr<apache::thrift::protocol::TProtocol> createProtocol(
+    Protocol protocol_,
+    std::shared_ptr<apache::thrift::transport::TTransport> transport_)
+  {
+    using namespace ::apache::thrift::protocol;
+
+    switch (protocol_)
+    {
+      case Protocol::Binary:
+        return std::make_shared<TBinaryProtocol>(transport_);
+      case Protocol::Compact:
+        return std::make_shared<TCompactProtocol>(transport_);
+      case Protocol::JSON:
+      default:
+        return std::make_shared<TJSONProtocol>(transport_);
+    }
+  }
+
   LoggingProcessor _processor;
+
+  /**
+   * The size of the previous response, used as the initial size of the next
+   * output buffer.
+   */
+  std::atomic<std::uint32_t> _lastResponseSize{0};
 };
 
+template <class Processor>
+constexpr std::uint32_t ThriftHandler<Processor>::MIN_OUTPUT_BUFFER_SIZE;
+
+template <class Processor>
+constexpr std::uint32_t ThriftHandler<Processor>::MAX_OUTPUT_BUFFER_SIZE;
+
+template <class Processor>
+constexpr std::uint32_t ThriftHandler<Processor>::MIN_COMPRESSED_RESPONSE_SIZE;
+
+template <class Processor>
+constexpr std::size_t ThriftHandler<Processor>::MAX_LOGGED_CONTENT_LENGTH;
+
 } // namespace webserver
 } // cc
 
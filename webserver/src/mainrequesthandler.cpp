@@ -1,5 +1,13 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <random>
+#include <sstream>
+
+#include <util/compression.h>
 #include <util/logutil.h>
 #include <util/util.h>
+#include <util/webserverutil.h>
 
 #include "mainrequesthandler.h"
 
@@ -36,11 +44,78 @@ static void writeRedirect(struct mg_connection* conn_, const char* loc_)
   mg_write(conn_, "\r\n\r\n", 4);
 }
 
+/**
+ * Returns the value of the Content-Type header of a part of a multipart
+ * request. The headers of the part are between begin_ and end_.
+ */
+static std::string partContentType(const char* begin_, const char* end_)
+{
+  static const std::string header = "\nContent-Type:";
+
+  const char* it = std::search(begin_, end_, header.begin(), header.end(),
+    [](char a_, char b_) { return std::tolower(a_) == std::tolower(b_); });
+
+  if (it == end_)
+    return "application/x-thrift";
+
+  it += header.size();
+  while (it < end_ && std::isblank(*it))
+    ++it;
+
+  const char* last = std::find(it, end_, '\r');
+  return std::string(it, last);
+}
+
+static std::string randomBoundary()
+{
+  std::random_device random;
+  std::ostringstream boundary;
+
+  boundary << "batch_" << std::hex << random() << random() << random();
+
+  return boundary.str();
+}
+
 namespace cc
 {
 namespace webserver
 {
 
+namespace
+{
+
+/**
+ * The number of calls in a batch request is limited, so that a single
+ * request can't occupy the server for long.
+ */
+constexpr std::size_t MAX_BATCH_CALLS = 64;
+
+/**
+ * Batch responses smaller than this are not compressed.
+ */
+constexpr std::size_t MIN_COMPRESSED_BATCH_SIZE = 1024;
+
+/**
+ * The reply of a batch call which has failed without a reply of its own.
+ */
+const char* const BATCH_CALL_ERROR
+  = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n";
+
+}
+
+/**
+ * A service call in a batch request.
+ */
+struct MainRequestHandler::BatchCall
+{
+  std::string uri;
+  std::string contentType;
+  const char* content;
+  int contentLen;
+  struct mg_connection* subrequest;
+  std::string reply;
+};
+
 static void logRequest(const struct mg_connection* conn_, const Session* sess_)
 {
   std::string username = sess_ ? sess_->username : "Anonymous";
@@ -95,9 +170,15 @@ int MainRequestHandler::begin_request_handler(struct mg_connection* conn_)
     }
   }
 
+  // Text files are sent compressed, the others by mongoose.
+  std::string path = getStaticContentPath(uri);
+
+  if (!path.empty() && _staticContent->send(conn_, path))
+    return MG_TRUE;
+
   if (uri.find("doxygen/") == 0)
   {
-    mg_send_file(conn_, getDocDirByURI(uri).c_str());
+    mg_send_file(conn_, path.c_str());
     return MG_MORE;
   }
 
@@ -152,10 +233,181 @@ int MainRequestHandler::operator()(struct mg_connection* conn_,
     return MG_TRUE;
   }
 
+  if (strcmp("/Batch", conn_->uri) == 0)
+    return handleBatch(conn_);
+
   return executeWithSessionContext(
     sessCookie, [this, &conn_]() { return begin_request_handler(conn_); });
 }
 
+int MainRequestHandler::handleBatch(struct mg_connection* conn_)
+{
+  std::vector<BatchCall> calls;
+
+  char name[256];
+  char fileName[256];
+  const char* data;
+  int dataLen;
+  int pos = 0;
+  int len = static_cast<int>(conn_->content_len);
+
+  while (int n = mg_parse_multipart(conn_->content + pos, len - pos,
+    name, sizeof(name), fileName, sizeof(fileName), &data, &dataLen))
+  {
+    calls.push_back(BatchCall{
+      std::string("/") + name,
+      partContentType(conn_->content + pos, data),
+      data,
+      dataLen,
+      nullptr,
+      std::string()});
+
+    pos += n;
+  }
+
+  if (calls.empty() || calls.size() > MAX_BATCH_CALLS)
+  {
+    mg_send_status(conn_, 400); // 400 Bad Request.
+    mg_send_header(conn_, "Content-Type", "text/plain");
+    mg_printf_data(conn_, "A batch request has to contain 1 to %d calls "
+      "as multipart/form-data parts.", static_cast<int>(MAX_BATCH_CALLS));
+    return MG_TRUE;
+  }
+
+  //--- Execute the calls ---//
+
+  // The subrequests are served like the requests of their services: they are
+  // authenticated by the session cookie of the batch request, and their
+  // endpoints are the services.
+  std::vector<ThreadedMongoose::Subrequest> subrequests;
+
+  for (BatchCall& call : calls)
+    if ((call.subrequest = createSubrequest(conn_, call)))
+      subrequests.emplace_back(call.uri.substr(1), call.subrequest);
+
+  if (server)
+    server->serve(subrequests);
+  else
+    for (const ThreadedMongoose::Subrequest& subrequest : subrequests)
+      (*this)(subrequest.second, MG_REQUEST);
+
+  for (BatchCall& call : calls)
+  {
+    if (!call.subrequest)
+      continue;
+
+    std::size_t replyLen;
+    const char* reply = mg_get_buffered_reply(call.subrequest, &replyLen);
+
+    call.reply = replyLen ? std::string(reply, replyLen) : BATCH_CALL_ERROR;
+
+    mg_destroy_request_copy(call.subrequest);
+  }
+
+  //--- Send the replies as a multipart/mixed response ---//
+
+  std::string boundary;
+  do
+  {
+    boundary = randomBoundary();
+  } while (std::any_of(calls.begin(), calls.end(),
+    [&boundary](const BatchCall& call_) {
+      return call_.reply.find(boundary) != std::string::npos;
+    }));
+
+  std::string body;
+  for (std::size_t i = 0; i < calls.size(); ++i)
+  {
+    body += "--" + boundary + "\r\n"
+      "Content-Type: application/http\r\n"
+      "Content-ID: " + std::to_string(i) + "\r\n\r\n";
+    body += calls[i].reply;
+    body += "\r\n";
+  }
+  body += "--" + boundary + "--\r\n";
+
+  std::string compressed;
+  bool gzip = body.size() >= MIN_COMPRESSED_BATCH_SIZE &&
+    util::acceptsEncoding(mg_get_header(conn_, "Accept-Encoding"), "gzip") &&
+    util::gzipCompress(body.data(), body.size(), compressed) &&
+    compressed.size() < body.size();
+
+  if (gzip)
+    body.swap(compressed);
+
+  mg_send_header(conn_, "Content-Type",
+    ("multipart/mixed; boundary=" + boundary).c_str());
+
+  if (gzip)
+    mg_send_header(conn_, "Content-Encoding", "gzip");
+
+  mg_send_header(conn_, "Content-Length", std::to_string(body.size()).c_str());
+  mg_write(conn_, "\r\n", 2);
+  mg_write(conn_, body.data(), body.size());
+
+  return MG_TRUE;
+}
+
+struct mg_connection* MainRequestHandler::createSubrequest(
+  struct mg_connection* conn_,
+  BatchCall& call_)
+{
+  // Only the services can be called in a batch, i.e. batches can't be nested.
+  if (!pluginHandler.getImplementation(call_.uri.substr(1)))
+  {
+    call_.reply = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    return nullptr;
+  }
+
+  struct mg_connection* subrequest
+    = mg_create_subrequest(conn_, call_.content, call_.contentLen);
+  if (!subrequest)
+  {
+    call_.reply = BATCH_CALL_ERROR;
+    return nullptr;
+  }
+
+  subrequest->uri = call_.uri.c_str();
+
+  // The headers describing the content of the batch request are replaced by
+  // the ones of the call. The reply of the call is not compressed, the whole
+  // batch response is.
+  int numHeaders = 0;
+  for (int i = 0; i < subrequest->num_headers; ++i)
+  {
+    const char* header = subrequest->http_headers[i].name;
+
+    if (strcasecmp(header, "Content-Type") != 0 &&
+        strcasecmp(header, "Content-Length") != 0 &&
+        strcasecmp(header, "Accept-Encoding") != 0)
+      subrequest->http_headers[numHeaders++] = subrequest->http_headers[i];
+  }
+
+  const int maxHeaders = sizeof(subrequest->http_headers)
+    / sizeof(subrequest->http_headers[0]);
+  numHeaders = std::min(numHeaders, maxHeaders - 1);
+
+  subrequest->http_headers[numHeaders].name = "Content-Type";
+  subrequest->http_headers[numHeaders].value = call_.contentType.c_str();
+  subrequest->num_headers = numHeaders + 1;
+
+  return subrequest;
+}
+
+std::string MainRequestHandler::endpoint(const struct mg_connection* conn_)
+{
+  // We advance it by one because of the '/' character.
+  std::string uri = conn_->uri + 1;
+
+  if (uri == "Batch" || pluginHandler.getImplementation(uri))
+    return uri;
+
+  std::string path = getStaticContentPath(uri);
+
+  return !path.empty() && _staticContent->needsLoad(conn_, path)
+    ? "StaticContent" : std::string();
+}
+
 std::string MainRequestHandler::getDocDirByURI(std::string uri_)
 {
   if (uri_.empty())
@@ -173,7 +425,27 @@ std::string MainRequestHandler::getDocDirByURI(std::string uri_)
   if (pos2 != std::string::npos)
     file = uri_.substr(pos2);
 
-  return dataDir[ws] + "/docs" + file;
+  // The map is not modified, because this function is called by several
+  // threads.
+  auto it = dataDir.find(ws);
+
+  return (it != dataDir.end() ? it->second : std::string()) + "/docs" + file;
+}
+
+std::string MainRequestHandler::getStaticContentPath(const std::string& uri_)
+{
+  if (uri_.find("doxygen/") == 0)
+    return getDocDirByURI(uri_);
+
+  if (webguiDir.empty())
+    return std::string();
+
+  std::string path = webguiDir + uri_;
+
+  if (path.back() == '/')
+    path += "index.html";
+
+  return path;
 }
 
 } // namespace webserver
@@ -1,9 +1,14 @@
 #ifndef CC_WEBSERVER_MAINREQUESTHANDLER_H
 #define CC_WEBSERVER_MAINREQUESTHANDLER_H
 
+#include <memory>
+
 #include <webserver/pluginhandler.h>
 #include <webserver/requesthandler.h>
 
+#include "staticcontent.h"
+#include "threadedmongoose.h"
+
 namespace cc
 {
 namespace webserver
@@ -19,13 +24,61 @@ public:
   PluginHandler<RequestHandler> pluginHandler;
   std::map<std::string, std::string> dataDir;
   std::string gaTrackingIdPath;
+  std::string webguiDir;
+
+  /**
+   * The server which executes the calls of batch requests concurrently. If
+   * it's not set then the calls are executed one after the other.
+   */
+  ThreadedMongoose* server = nullptr;
 
   int operator()(struct mg_connection* conn_, enum mg_event ev_);
 
+  /**
+   * This function returns the name of the service plugin which serves the
+   * request, or an empty string for static content. Service requests are
+   * served on the worker threads of the server, limited per service. Static
+   * content which has to be read from the disk first is served by the
+   * workers too, as the "StaticContent" endpoint.
+   */
+  std::string endpoint(const struct mg_connection* conn_);
+
 private:
+  struct BatchCall;
+
   int begin_request_handler(struct mg_connection* conn_);
+
+  /**
+   * Serves a batch request which contains several service calls as the parts
+   * of a multipart/form-data request. The name of a part is the URI of the
+   * service, its content is the request to the service. The calls are
+   * executed concurrently as subrequests of the batch request on the workers
+   * of the server, each under the limit of its own service. The replies are
+   * sent in the order of the calls in a multipart/mixed response, each part
+   * is an application/http message.
+   */
+  int handleBatch(struct mg_connection* conn_);
+
+  /**
+   * This function creates the subrequest of a batch call, or returns nullptr
+   * if the call can't be served. In that case the reply of the call is set.
+   */
+  struct mg_connection* createSubrequest(
+    struct mg_connection* conn_,
+    BatchCall& call_);
+
   std::string getDocDirByURI(std::string uri_);
 
+  /**
+   * This function returns the path of the file which may be served by
+   * StaticContent for the given URI (without the leading '/'), or an empty
+   * string if the URI doesn't belong to the documentation or the web GUI.
+   */
+  std::string getStaticContentPath(const std::string& uri_);
+
+  std::shared_ptr<StaticContent> _staticContent
+    = std::make_shared<StaticContent>();
+
   // Detail template - implementation in the .cpp only.
   template <typename F>
   auto executeWithSessionContext(cc::webserver::Session* sess_, F func);
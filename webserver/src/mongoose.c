@@ -1315,6 +1315,7 @@ struct connection {
 
 static void open_local_endpoint(struct connection *conn, int skip_user);
 static void close_local_endpoint(struct connection *conn);
+static void write_terminating_chunk(struct connection *conn);
 
 static const struct {
   const char *extension;
@@ -2461,6 +2462,105 @@ size_t mg_printf_data(struct mg_connection *c, const char *fmt, ...) {
   return conn->ns_conn->send_iobuf.len;
 }
 
+// Creates a copy of the request of the given connection with the given
+// content. The reply written to the copy is buffered, it can be obtained by
+// mg_get_buffered_reply().
+static struct mg_connection *copy_request(struct mg_connection *c,
+                                          const char *content,
+                                          size_t content_len) {
+  struct connection *src = MG_CONN_2_CONN(c);
+  struct connection *conn = (struct connection *) calloc(1, sizeof(*conn));
+  struct ns_connection *nc = (struct ns_connection *) calloc(1, sizeof(*nc));
+  struct mg_connection *copy;
+  int i;
+
+  if (conn == NULL || nc == NULL) {
+    free(conn);
+    free(nc);
+    return NULL;
+  }
+
+  nc->sock = INVALID_SOCKET;
+  nc->connection_data = conn;
+  conn->ns_conn = nc;
+  conn->server = src->server;
+  conn->endpoint_type = EP_USER;
+  conn->cl = content_len;
+  conn->request_len = src->request_len;
+
+  copy = &conn->mg_conn;
+  *copy = *c;
+
+  // The parsed request points into the request buffer, so the pointers are
+  // rebased into the copy of the buffer.
+  if ((conn->request = (char *) malloc(src->request_len)) == NULL ||
+      iobuf_append(&nc->recv_iobuf, content, content_len) != content_len) {
+    mg_destroy_request_copy(copy);
+    return NULL;
+  }
+  memcpy(conn->request, src->request, src->request_len);
+
+#define REBASE(p) ((p) == NULL ? NULL : conn->request + ((p) - src->request))
+  copy->request_method = REBASE(c->request_method);
+  copy->uri = REBASE(c->uri);
+  copy->http_version = REBASE(c->http_version);
+  copy->query_string = REBASE(c->query_string);
+  for (i = 0; i < c->num_headers; i++) {
+    copy->http_headers[i].name = REBASE(c->http_headers[i].name);
+    copy->http_headers[i].value = REBASE(c->http_headers[i].value);
+  }
+#undef REBASE
+
+  copy->content = nc->recv_iobuf.buf;
+  copy->content_len = content_len;
+  copy->connection_param = NULL;
+
+  return copy;
+}
+
+// Creates a copy of the request which can be served on another thread. The
+// original connection is not closed as idle until its request is finished.
+struct mg_connection *mg_copy_request(struct mg_connection *c) {
+  struct mg_connection *copy = copy_request(c, c->content, c->content_len);
+
+  if (copy != NULL) {
+    MG_CONN_2_CONN(c)->ns_conn->flags |= MG_LONG_RUNNING;
+  }
+
+  return copy;
+}
+
+// Creates a request with the headers of the given request and the given
+// content, e.g. a part of a multipart request.
+struct mg_connection *mg_create_subrequest(struct mg_connection *c,
+                                           const char *content,
+                                           size_t content_len) {
+  return copy_request(c, content, content_len);
+}
+
+const char *mg_get_buffered_reply(struct mg_connection *c, size_t *len) {
+  struct connection *conn = MG_CONN_2_CONN(c);
+
+  if (conn->ns_conn->flags & MG_HEADERS_SENT) {
+    write_terminating_chunk(conn);
+    conn->ns_conn->flags &= ~MG_HEADERS_SENT;
+  }
+
+  *len = conn->ns_conn->send_iobuf.len;
+  return conn->ns_conn->send_iobuf.buf;
+}
+
+void mg_destroy_request_copy(struct mg_connection *c) {
+  struct connection *conn = MG_CONN_2_CONN(c);
+
+  iobuf_free(&conn->ns_conn->recv_iobuf);
+  iobuf_free(&conn->ns_conn->send_iobuf);
+  free(conn->ns_conn);
+  free(conn->request);
+  free(conn->path_info);
+  free(conn);
+}
+
 #if !defined(MONGOOSE_NO_WEBSOCKET) || !defined(MONGOOSE_NO_AUTH)
 static int is_big_endian(void) {
   static const int n = 1;
@@ -4986,7 +5086,8 @@ static void mg_ev_handler(struct ns_connection *nc, enum ns_event ev, void *p) {
           ping_idle_websocket_connection(conn, current_time);
         }
 
-        if (nc->last_io_time + MONGOOSE_IDLE_TIMEOUT_SECONDS < current_time) {
+        if (nc->last_io_time + MONGOOSE_IDLE_TIMEOUT_SECONDS < current_time &&
+            !(nc->flags & MG_LONG_RUNNING)) {
           mg_ev_handler(nc, NS_CLOSE, NULL);
           nc->flags |= NSF_CLOSE_IMMEDIATELY;
         }
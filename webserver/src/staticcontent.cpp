@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <util/compression.h>
+#include <util/hash.h>
+#include <util/logutil.h>
+#include <util/webserverutil.h>
+
+#include "staticcontent.h"
+
+namespace
+{
+
+/**
+ * Fixed overhead of a cache entry: the list and hash table nodes, the key
+ * and the content object.
+ */
+constexpr std::size_t ENTRY_OVERHEAD = 256;
+
+std::string httpDate(std::time_t time_)
+{
+  char date[64];
+  std::strftime(
+    date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", std::gmtime(&time_));
+  return date;
+}
+
+}
+
+namespace cc
+{
+namespace webserver
+{
+
+const std::size_t StaticContent::DEFAULT_CAPACITY;
+const off_t StaticContent::MAX_FILE_SIZE;
+const std::size_t StaticContent::MIN_COMPRESSED_SIZE;
+
+StaticContent::StaticContent(std::size_t capacityBytes_)
+  : _cache(capacityBytes_, [](const ContentPtr& content_) {
+      return ENTRY_OVERHEAD + content_->data.size() + content_->gzipped.size();
+    })
+{
+}
+
+bool StaticContent::isText(const std::string& path_)
+{
+  static const char* const extensions[] = {
+    ".html", ".htm", ".css", ".js", ".json", ".map", ".svg", ".txt", ".xml"};
+
+  return std::any_of(std::begin(extensions), std::end(extensions),
+    [&path_](const char* ext_)
+    {
+      std::size_t len = std::strlen(ext_);
+      return path_.size() > len &&
+        path_.compare(path_.size() - len, len, ext_) == 0;
+    });
+}
+
+bool StaticContent::isServed(
+  const struct mg_connection* conn_,
+  const std::string& path_,
+  struct stat& st_)
+{
+  if (std::strcmp(conn_->request_method, "GET") != 0 &&
+      std::strcmp(conn_->request_method, "HEAD") != 0)
+    return false;
+
+  return isText(path_) &&
+    ::stat(path_.c_str(), &st_) == 0 &&
+    S_ISREG(st_.st_mode) &&
+    st_.st_size <= MAX_FILE_SIZE;
+}
+
+bool StaticContent::isUpToDate(
+  const ContentPtr& content_,
+  const struct stat& st_)
+{
+  return content_->mtime == st_.st_mtime && content_->size == st_.st_size;
+}
+
+bool StaticContent::needsLoad(
+  const struct mg_connection* conn_,
+  const std::string& path_)
+{
+  struct stat st;
+
+  if (!isServed(conn_, path_, st))
+    return false;
+
+  ContentPtr content;
+  return !_cache.get(path_, content) || !isUpToDate(content, st);
+}
+
+StaticContent::ContentPtr StaticContent::load(
+  const std::string& path_,
+  std::time_t mtime_,
+  off_t size_)
+{
+  std::ifstream file(path_, std::ios::binary);
+
+  if (!file)
+    return nullptr;
+
+  std::shared_ptr<Content> content = std::make_shared<Content>();
+  content->mtime = mtime_;
+  content->size = size_;
+  content->data.assign(
+    std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+  if (file.bad())
+    return nullptr;
+
+  content->etag = '"' + util::sha1Hash(content->data);
+
+  if (content->data.size() >= MIN_COMPRESSED_SIZE &&
+      (!util::gzipCompress(
+        content->data.data(), content->data.size(), content->gzipped) ||
+       content->gzipped.size() >= content->data.size()))
+    content->gzipped.clear();
+
+  LOG(debug)
+    << "Static content loaded: " << path_ << " (" << content->data.size()
+    << " bytes, " << content->gzipped.size() << " bytes compressed)";
+
+  return content;
+}
+
+bool StaticContent::send(struct mg_connection* conn_, const std::string& path_)
+{
+  struct stat st;
+
+  if (!isServed(conn_, path_, st))
+    return false;
+
+  bool head = std::strcmp(conn_->request_method, "HEAD") == 0;
+
+  ContentPtr content;
+
+  if (!_cache.get(path_, content) || !isUpToDate(content, st))
+  {
+    content = load(path_, st.st_mtime, st.st_size);
+
+    if (!content)
+      return false;
+
+    _cache.put(path_, content);
+  }
+
+  bool compressible = !content->gzipped.empty();
+  std::string etag = content->etag + '"';
+  std::string gzipEtag = content->etag + "-gzip\"";
+
+  const char* ifNoneMatch = mg_get_header(conn_, "If-None-Match");
+  bool notModified = util::matchesEntityTag(ifNoneMatch, etag) ||
+    (compressible && util::matchesEntityTag(ifNoneMatch, gzipEtag));
+
+  bool gzip = compressible &&
+    util::acceptsEncoding(mg_get_header(conn_, "Accept-Encoding"), "gzip");
+
+  const std::string& body = gzip ? content->gzipped : content->data;
+
+  mg_send_status(conn_, notModified ? 304 : 200);
+  mg_send_header(conn_, "Content-Type",
+    mg_get_mime_type(path_.c_str(), "text/plain"));
+  mg_send_header(conn_, "Last-Modified", httpDate(content->mtime).c_str());
+  mg_send_header(conn_, "ETag", gzip ? gzipEtag.c_str() : etag.c_str());
+
+  if (compressible)
+    mg_send_header(conn_, "Vary", "Accept-Encoding");
+
+  if (!notModified)
+  {
+    if (gzip)
+      mg_send_header(conn_, "Content-Encoding", "gzip");
+
+    mg_send_header(
+      conn_, "Content-Length", std::to_string(body.size()).c_str());
+  }
+
+  mg_write(conn_, "\r\n", 2);
+
+  if (!notModified && !head)
+    mg_write(conn_, body.data(), body.size());
+
+  return true;
+}
+
+} // webserver
+} // cc
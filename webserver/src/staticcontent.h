@@ -0,0 +1,95 @@
+#ifndef CC_WEBSERVER_STATICCONTENT_H
+#define CC_WEBSERVER_STATICCONTENT_H
+
+#include <ctime>
+#include <memory>
+#include <string>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <util/lrucache.h>
+
+#include <webserver/mongoose.h>
+
+namespace cc
+{
+namespace webserver
+{
+
+/**
+ * Serves the text files of the web GUI and the documentation (HTML, scripts,
+ * style sheets etc.) with a strong entity tag derived from the content of the
+ * file and with gzip encoding if the client accepts it. Repeated requests
+ * with a matching If-None-Match header get 304 Not Modified.
+ *
+ * The content, its hash and its compressed form are cached in memory until
+ * the modification time or the size of the file changes. Other files are
+ * left to mongoose.
+ */
+class StaticContent
+{
+public:
+  StaticContent(std::size_t capacityBytes_ = DEFAULT_CAPACITY);
+
+  /**
+   * This function sends the given file if it is a text file.
+   * @return False if the file is not served by this class, e.g. it doesn't
+   * exist or it is an image.
+   */
+  bool send(struct mg_connection* conn_, const std::string& path_);
+
+  /**
+   * This function returns true if send() would serve the file but it has to
+   * read the file first, because the file is not cached or it has changed.
+   * Reading, hashing and compressing a file is too slow for the I/O thread of
+   * the server, so such requests are served by a worker.
+   */
+  bool needsLoad(const struct mg_connection* conn_, const std::string& path_);
+
+private:
+  struct Content
+  {
+    std::time_t mtime;
+    off_t size;
+    std::string etag;
+    std::string data;
+    std::string gzipped;
+  };
+
+  typedef std::shared_ptr<const Content> ContentPtr;
+
+  static const std::size_t DEFAULT_CAPACITY = 64 * 1024 * 1024;
+
+  /**
+   * Larger files are sent by mongoose without reading them into the memory.
+   */
+  static const off_t MAX_FILE_SIZE = 16 * 1024 * 1024;
+
+  /**
+   * Smaller files are not compressed.
+   */
+  static const std::size_t MIN_COMPRESSED_SIZE = 1024;
+
+  static bool isText(const std::string& path_);
+
+  /**
+   * This function returns true if the request is served by this class and
+   * fills the status of the file.
+   */
+  static bool isServed(
+    const struct mg_connection* conn_,
+    const std::string& path_,
+    struct stat& st_);
+
+  static bool isUpToDate(const ContentPtr& content_, const struct stat& st_);
+
+  ContentPtr load(const std::string& path_, std::time_t mtime_, off_t size_);
+
+  util::LruCache<std::string, ContentPtr> _cache;
+};
+
+} // webserver
+} // cc
+
+#endif // CC_WEBSERVER_STATICCONTENT_H
@@ -1,10 +1,73 @@
+#include <algorithm>
+#include <atomic>
+
+#include <util/logutil.h>
+
 #include "threadedmongoose.h"
 
+namespace
+{
+
+typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+double toMilliseconds(std::chrono::steady_clock::duration duration_)
+{
+  return std::chrono::duration_cast<Milliseconds>(duration_).count();
+}
+
+void sendServiceUnavailable(mg_connection* conn_)
+{
+  mg_send_status(conn_, 503); // 503 Service Unavailable.
+  mg_send_header(conn_, "Content-Type", "text/plain");
+  mg_send_header(conn_, "Retry-After", "1");
+  mg_printf_data(conn_, "%s", "Server is busy.");
+}
+
+}
+
 namespace cc
 {
 namespace webserver
 {
 
+/**
+ * A request served by a worker. The copy of a request of a connection is owned
+ * by this object. The worker sets done when the reply is in the copy, the I/O
+ * thread sets abandoned if the client closes the connection before.
+ *
+ * A subrequest (see ThreadedMongoose::serve()) is owned by the caller of
+ * serve() instead, and pending points to the number of its unfinished
+ * subrequests.
+ */
+struct ThreadedMongoose::Request
+{
+  Request(
+    std::string endpoint_,
+    mg_connection* copy_,
+    std::size_t* pending_ = nullptr)
+    : endpoint(std::move(endpoint_)),
+      copy(copy_),
+      pending(pending_),
+      queued(std::chrono::steady_clock::now()),
+      done(false),
+      abandoned(false)
+  {
+  }
+
+  ~Request()
+  {
+    if (!pending)
+      mg_destroy_request_copy(copy);
+  }
+
+  std::string endpoint;
+  mg_connection* copy;
+  std::size_t* pending;
+  std::chrono::steady_clock::time_point queued;
+  std::atomic_bool done;
+  std::atomic_bool abandoned;
+};
+
 SignalChanger::SignalChanger(int signum_, SignalHandler newHandler_)
 {
   _origSignum = signum_;
@@ -16,13 +79,21 @@ SignalChanger::~SignalChanger()
   signal(_origSignum, _origHandler);
 }
 
-volatile int ThreadedMongoose::exitFlag = 0;
+std::atomic_int ThreadedMongoose::exitFlag(0);
 
 const unsigned ThreadedMongoose::DEFAULT_MAX_THREAD;
+const std::size_t ThreadedMongoose::DEFAULT_MAX_QUEUED_REQUESTS;
 
-ThreadedMongoose::Handler ThreadedMongoose::handler;
-
-ThreadedMongoose::ThreadedMongoose(int numThreads_) : _numThreads(numThreads_)
+ThreadedMongoose::ThreadedMongoose(int numThreads_)
+  : _numThreads(numThreads_),
+    _endpointConcurrency(0),
+    _maxQueuedRequests(DEFAULT_MAX_QUEUED_REQUESTS),
+    _server(nullptr),
+    _stopWorkers(false),
+    _wakeupPending(false),
+    _wakeupRequested(false),
+    _stopWaker(false),
+    _wakerDone(false)
 {
 }
 
@@ -38,35 +109,447 @@ std::string ThreadedMongoose::getOption(const std::string& optName_)
   return _options[optName_];
 }
 
-void ThreadedMongoose::run(Handler handler_)
+void ThreadedMongoose::setEndpointConcurrency(int endpointConcurrency_)
 {
-  run((void*)0, handler_);
+  _endpointConcurrency = endpointConcurrency_;
 }
 
-void ThreadedMongoose::signalHandler(int sigNum_)
-{ 
-  ThreadedMongoose::exitFlag = sigNum_;
+void ThreadedMongoose::setMaxQueuedRequests(std::size_t maxQueuedRequests_)
+{
+  _maxQueuedRequests = maxQueuedRequests_;
 }
 
-void* ThreadedMongoose::serve(void* server_)
+void ThreadedMongoose::run(Handler handler_, Dispatcher dispatcher_)
 {
+  typedef std::shared_ptr<mg_server> ServerPtr;
+
+  _handler = handler_;
+  _dispatcher = dispatcher_;
+
+  exitFlag = 0;
+
+  SignalChanger termSig(SIGTERM, signalHandler);
+  SignalChanger intSig(SIGINT, signalHandler);
+
+  if (_numThreads < 1)
+  {
+    _numThreads
+      = std::max(std::thread::hardware_concurrency(), DEFAULT_MAX_THREAD);
+  }
+
+  if (_endpointConcurrency < 1)
+    _endpointConcurrency = std::max(_numThreads - 1, 1);
+
+  ServerPtr server = ServerPtr(
+    mg_create_server(this, delegater),
+    [](mg_server* s)
+    {
+      mg_destroy_server(&s);
+    });
+
+  for (const auto& opt : _options)
+  {
+    auto errormsg =
+      mg_set_option(server.get(), opt.first.c_str(), opt.second.c_str());
+
+    if (errormsg)
+    {
+      exitFlag = true;
+
+      std::string error = errormsg;
+      error += " Option: " + opt.first + " Value: " + opt.second;
+
+      throw std::runtime_error(error);
+    }
+  }
+
+  _server = server.get();
+  _stopWorkers = false;
+  _wakeupPending = false;
+  _wakeupRequested = false;
+  _stopWaker = false;
+  _wakerDone = false;
+
+  std::thread waker(&ThreadedMongoose::wake, this);
+
+  std::vector<std::thread> workers;
+  workers.reserve(_numThreads);
+
+  for (int i = 0; i < _numThreads; ++i)
+    workers.emplace_back(&ThreadedMongoose::work, this);
+
+  LOG(debug)
+    << "[webserver] Serving requests on " << _numThreads << " worker(s), "
+    << _endpointConcurrency << " per endpoint.";
+
   while (!exitFlag)
   {
-    mg_poll_server((mg_server*)server_, 1000);
+    // The finished requests are looked for at the beginning of the poll, so
+    // the workers finishing from now on need a new wakeup.
+    _wakeupPending = false;
+    mg_poll_server(_server, 1000);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_queueLock);
+    _stopWorkers = true;
+  }
+  _queueCond.notify_all();
+
+  for (std::thread& worker : workers)
+    worker.join();
+
+  {
+    std::lock_guard<std::mutex> lock(_wakerLock);
+    _stopWaker = true;
   }
-  
-  return nullptr;
+  _wakerCond.notify_all();
+
+  // The waker may be waiting for the I/O thread to receive its wakeup, so the
+  // server has to be polled until the waker exits.
+  while (!_wakerDone)
+    mg_poll_server(_server, 100);
+
+  waker.join();
+
+  _queue.clear();
+
+  logStatistics();
+
+  // ~server releases the server's resources
+  _server = nullptr;
+  server.reset();
+
+  // ~termSig and ~intSig restores signal handlers
+}
+
+void ThreadedMongoose::signalHandler(int sigNum_)
+{
+  ThreadedMongoose::exitFlag = sigNum_;
 }
 
 int ThreadedMongoose::delegater(mg_connection *conn_, enum mg_event ev_)
 {
-  if (handler)
+  ThreadedMongoose* self = static_cast<ThreadedMongoose*>(conn_->server_param);
+
+  switch (ev_)
   {
-    return handler(conn_, ev_);
+    case MG_REQUEST:
+      return self->onRequest(conn_);
+
+    case MG_POLL:
+      if (conn_->connection_param)
+        return self->onPoll(conn_);
+      break;
+
+    case MG_CLOSE:
+      self->onClose(conn_);
+      break;
+
+    default:
+      break;
   }
-  
+
+  if (self->_handler)
+    return self->_handler(conn_, ev_);
+
   return MG_FALSE;
 }
 
+int ThreadedMongoose::onRequest(mg_connection *conn_)
+{
+  // The request is being served by a worker. This happens when further data
+  // arrives on the connection.
+  if (conn_->connection_param)
+    return MG_MORE;
+
+  std::string endpoint = _dispatcher ? _dispatcher(conn_) : std::string();
+
+  if (endpoint.empty())
+    return _handler ? _handler(conn_, MG_REQUEST) : MG_FALSE;
+
+  {
+    std::lock_guard<std::mutex> lock(_queueLock);
+
+    if (_queue.size() >= _maxQueuedRequests)
+    {
+      ++_statistics[endpoint].rejected;
+
+      LOG(warning)
+        << "[webserver] Request queue is full, rejecting request of "
+        << endpoint;
+
+      sendServiceUnavailable(conn_);
+      return MG_TRUE;
+    }
+  }
+
+  mg_connection* copy = mg_copy_request(conn_);
+
+  if (!copy)
+    return _handler ? _handler(conn_, MG_REQUEST) : MG_FALSE;
+
+  RequestPtr request = std::make_shared<Request>(std::move(endpoint), copy);
+  conn_->connection_param = new RequestPtr(request);
+
+  {
+    std::lock_guard<std::mutex> lock(_queueLock);
+    _queue.push_back(std::move(request));
+  }
+  _queueCond.notify_all();
+
+  return MG_MORE;
+}
+
+int ThreadedMongoose::onPoll(mg_connection *conn_)
+{
+  RequestPtr* request = static_cast<RequestPtr*>(conn_->connection_param);
+
+  if (!(*request)->done.load(std::memory_order_acquire))
+    return MG_FALSE;
+
+  mg_connection* copy = (*request)->copy;
+
+  std::size_t len;
+  const char* reply = mg_get_buffered_reply(copy, &len);
+
+  if (len == 0)
+  {
+    mg_send_status(conn_, 500); // 500 Internal Server Error.
+    mg_send_header(conn_, "Content-Type", "text/plain");
+    mg_printf_data(conn_, "%s", "Internal Server Error.");
+  }
+  else
+  {
+    mg_write(conn_, reply, len);
+    conn_->status_code = copy->status_code;
+  }
+
+  delete request;
+  conn_->connection_param = nullptr;
+
+  return MG_TRUE;
+}
+
+void ThreadedMongoose::onClose(mg_connection *conn_)
+{
+  RequestPtr* request = static_cast<RequestPtr*>(conn_->connection_param);
+
+  if (!request)
+    return;
+
+  (*request)->abandoned = true;
+
+  delete request;
+  conn_->connection_param = nullptr;
+}
+
+ThreadedMongoose::RequestPtr ThreadedMongoose::nextRequest()
+{
+  std::unique_lock<std::mutex> lock(_queueLock);
+  RequestPtr request;
+
+  _queueCond.wait(lock, [this, &request]()
+  {
+    if (_stopWorkers)
+      return true;
+
+    // The first request whose endpoint has a free slot is served, so the
+    // requests of a busy endpoint don't block the others.
+    auto it = std::find_if(_queue.begin(), _queue.end(),
+      [this](const RequestPtr& request_)
+      {
+        return request_->abandoned ||
+          _running[request_->endpoint] < _endpointConcurrency;
+      });
+
+    if (it == _queue.end())
+      return false;
+
+    request = std::move(*it);
+    _queue.erase(it);
+    return true;
+  });
+
+  if (request && !request->abandoned)
+    ++_running[request->endpoint];
+
+  return request;
+}
+
+void ThreadedMongoose::work()
+{
+  RequestPtr request;
+
+  while ((request = nextRequest()))
+  {
+    if (request->abandoned)
+      continue;
+
+    serveRequest(*request);
+
+    // The caller of serve() takes the replies of the subrequests.
+    if (request->pending)
+      continue;
+
+    request->done.store(true, std::memory_order_release);
+    request.reset();
+
+    requestWakeup();
+  }
+}
+
+void ThreadedMongoose::serve(const std::vector<Subrequest>& subrequests_)
+{
+  std::size_t pending = subrequests_.size();
+
+  if (pending == 0)
+    return;
+
+  // The subrequests belong to a request which has already been admitted, so
+  // they are not rejected by the queue limit.
+  {
+    std::lock_guard<std::mutex> lock(_queueLock);
+
+    for (const Subrequest& subrequest : subrequests_)
+      _queue.push_back(std::make_shared<Request>(
+        subrequest.first, subrequest.second, &pending));
+  }
+  _queueCond.notify_all();
+
+  std::unique_lock<std::mutex> lock(_queueLock);
+
+  while (pending > 0)
+  {
+    auto it = std::find_if(_queue.begin(), _queue.end(),
+      [this, &pending](const RequestPtr& request_)
+      {
+        return request_->pending == &pending &&
+          _running[request_->endpoint] < _endpointConcurrency;
+      });
+
+    if (it == _queue.end())
+    {
+      _queueCond.wait(lock);
+      continue;
+    }
+
+    RequestPtr request = std::move(*it);
+    _queue.erase(it);
+    ++_running[request->endpoint];
+
+    lock.unlock();
+    serveRequest(*request);
+    lock.lock();
+  }
+}
+
+void ThreadedMongoose::serveRequest(Request& request_)
+{
+  std::chrono::steady_clock::time_point started
+    = std::chrono::steady_clock::now();
+
+  try
+  {
+    _handler(request_.copy, MG_REQUEST);
+  }
+  catch (const std::exception& ex)
+  {
+    LOG(error)
+      << "[webserver] Serving request of " << request_.endpoint
+      << " failed: " << ex.what();
+  }
+  catch (...)
+  {
+    LOG(error)
+      << "[webserver] Serving request of " << request_.endpoint
+      << " failed.";
+  }
+
+  std::chrono::steady_clock::time_point finished
+    = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::duration queueTime = started - request_.queued;
+  std::chrono::steady_clock::duration runTime = finished - started;
+
+  {
+    std::lock_guard<std::mutex> lock(_queueLock);
+
+    --_running[request_.endpoint];
+
+    EndpointStatistics& stat = _statistics[request_.endpoint];
+    ++stat.requests;
+    stat.totalQueueTime += queueTime;
+    stat.maxQueueTime = std::max(stat.maxQueueTime, queueTime);
+    stat.totalRunTime += runTime;
+    stat.maxRunTime = std::max(stat.maxRunTime, runTime);
+
+    // The caller of serve() may return as soon as the counter drops to zero,
+    // so it must not be touched after the lock is released.
+    if (request_.pending)
+      --*request_.pending;
+  }
+
+  // A request of this endpoint may be waiting for the freed slot, or the
+  // caller of serve() for its subrequests.
+  _queueCond.notify_all();
+
+  LOG(debug)
+    << "[webserver] " << request_.endpoint << " request waited "
+    << toMilliseconds(queueTime) << " ms in the queue, served in "
+    << toMilliseconds(runTime) << " ms";
+}
+
+void ThreadedMongoose::requestWakeup()
+{
+  if (_wakeupPending.exchange(true))
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(_wakerLock);
+    _wakeupRequested = true;
+  }
+  _wakerCond.notify_one();
+}
+
+void ThreadedMongoose::wake()
+{
+  std::unique_lock<std::mutex> lock(_wakerLock);
+
+  for (;;)
+  {
+    _wakerCond.wait(lock, [this]{ return _wakeupRequested || _stopWaker; });
+
+    if (!_wakeupRequested)
+      break;
+
+    _wakeupRequested = false;
+
+    lock.unlock();
+    mg_wakeup_server(_server);
+    lock.lock();
+  }
+
+  _wakerDone = true;
+}
+
+void ThreadedMongoose::logStatistics()
+{
+  std::lock_guard<std::mutex> lock(_queueLock);
+
+  for (const auto& stat : _statistics)
+  {
+    const EndpointStatistics& s = stat.second;
+    std::size_t requests = std::max<std::size_t>(s.requests, 1);
+
+    LOG(info)
+      << "[webserver] " << stat.first << ": " << s.requests
+      << " request(s), " << s.rejected << " rejected, queue time avg "
+      << toMilliseconds(s.totalQueueTime) / requests << " ms, max "
+      << toMilliseconds(s.maxQueueTime) << " ms, run time avg "
+      << toMilliseconds(s.totalRunTime) / requests << " ms, max "
+      << toMilliseconds(s.maxRunTime) << " ms";
+  }
+}
+
 } // webserver
 } // cc
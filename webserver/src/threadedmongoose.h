@@ -1,11 +1,17 @@
 #ifndef CC_WEBSERVER_THREADEDMONGOOSE_H
 #define CC_WEBSERVER_THREADEDMONGOOSE_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 #include <signal.h>
 #include <stdexcept>
@@ -30,16 +36,45 @@ private:
   SignalHandler _origHandler;
 };
 
+/**
+ * Mongoose server which accepts connections and parses requests on a single
+ * I/O thread and serves the expensive requests on a pool of worker threads.
+ *
+ * A parsed request is either served on the I/O thread (e.g. static files) or
+ * copied and queued for the workers, based on the endpoint returned by the
+ * dispatcher. The number of workers serving the same endpoint at a time is
+ * limited, so that slow requests of an endpoint (e.g. diagram rendering) can't
+ * occupy every worker and cheap requests of other endpoints don't have to
+ * wait for them. The reply of a worker is written to the connection by the I/O
+ * thread.
+ *
+ * The I/O thread is woken up by a dedicated waker thread when workers finish,
+ * because waking up mongoose blocks until the I/O thread receives the message.
+ * The workers only signal the waker, and the requests finished between two
+ * polls share one wakeup. Every poll looks for the finished requests.
+ */
 class ThreadedMongoose
 {
 public:
   typedef std::function<int (mg_connection *, mg_event)> Handler;
 
+  /**
+   * This function returns the endpoint of the request which is the unit of
+   * the concurrency limit and the metrics. An empty string means that the
+   * request is cheap enough to be served on the I/O thread.
+   */
+  typedef std::function<std::string (const mg_connection *)> Dispatcher;
+
+  /**
+   * A request created by mg_create_subrequest() and the endpoint serving it.
+   */
+  typedef std::pair<std::string, mg_connection *> Subrequest;
+
   /**
    * Constructor for creating a multithreaded Mongoose server.
-   * @param numThreads_ Number of threads to run the server on. If its value is
-   * less than 1 then by default maximum the number of available cores and the
-   * value of DEFAULT_MAX_THREAD will be used.
+   * @param numThreads_ Number of worker threads. If its value is less than 1
+   * then by default maximum the number of available cores and the value of
+   * DEFAULT_MAX_THREAD will be used.
    */
   ThreadedMongoose(int numThreads_ = 0);
 
@@ -57,96 +92,115 @@ public:
    */
   std::string getOption(const std::string& optName_);
 
-  void run(Handler handler_);
+  /**
+   * This function sets the maximum number of workers which may serve the
+   * requests of the same endpoint at a time. If its value is less than 1 then
+   * all but one of the workers may be used by an endpoint.
+   */
+  void setEndpointConcurrency(int endpointConcurrency_);
 
-  template <typename T>
-  void run(T* serverData_, Handler handler_)
-  {
-    typedef std::shared_ptr<mg_server> ServerPtr;
-
-    handler = handler_;
-
-    exitFlag = 0;
-
-    SignalChanger termSig(SIGTERM, signalHandler);
-    SignalChanger intSig(SIGINT, signalHandler);
-
-    if (_numThreads < 1)
-    {
-      _numThreads
-        = std::max(std::thread::hardware_concurrency(), DEFAULT_MAX_THREAD);
-    }
-
-    std::vector<ServerPtr> servers;
-    servers.reserve(_numThreads);
-
-    std::vector<std::thread> threads;
-    threads.reserve(_numThreads - 1);
-
-    for (int i = 0; i < _numThreads; ++i)
-    {
-      ServerPtr server = ServerPtr(
-        mg_create_server((void*)serverData_, delegater),
-        [](mg_server* s)
-        {
-          mg_destroy_server(&s);
-        });
-
-      for (const auto& opt : _options)
-      {
-        // if we create more servers, we have to share the listening socket
-        if (opt.first == "listening_port" && i != 0)
-        {
-          mg_set_listening_socket(
-            server.get(), mg_get_listening_socket(servers[0].get()));
-        }
-        else
-        {
-          auto errormsg =
-            mg_set_option(server.get(), opt.first.c_str(), opt.second.c_str());
-
-          if (errormsg)
-          {
-            exitFlag = true;
-
-            std::string error = errormsg;
-            error += " Option: " + opt.first + " Value: " + opt.second;
-
-            throw std::runtime_error(error);
-          }
-        }
-      }
-
-      // if this is not the last server, create a new thread
-      if (i != _numThreads - 1)
-      {
-        threads.push_back(std::thread(serve, server.get()));
-      }
-      // this is the last server, run serve in current thread
-      else
-      {
-        serve(server.get());
-      }
-
-      servers.push_back(std::move(server));
-    }
-
-    // ~joiner waits for all threads to finish
-    // ~servers releases the servers' resources
-    // ~termSig and ~intSig restores signal handlers
-  }
+  /**
+   * This function sets the maximum number of requests waiting for a worker.
+   * Further requests are rejected with 503 Service Unavailable.
+   */
+  void setMaxQueuedRequests(std::size_t maxQueuedRequests_);
+
+  /**
+   * This function runs the server until SIGINT or SIGTERM. Without a
+   * dispatcher every request is served on the I/O thread.
+   */
+  void run(Handler handler_, Dispatcher dispatcher_ = Dispatcher());
+
+  /**
+   * This function serves the given subrequests concurrently on the workers,
+   * each under the limit of its own endpoint, and returns when all of them
+   * have been served. The replies are buffered in the subrequests, which
+   * remain owned by the caller. The function is called by a worker serving a
+   * request, e.g. a batch of service calls. While it waits, it serves those of
+   * its subrequests which no other worker has taken yet, so the workers
+   * waiting for subrequests can't make each other wait forever.
+   */
+  void serve(const std::vector<Subrequest>& subrequests_);
 
 private:
+  struct Request;
+  typedef std::shared_ptr<Request> RequestPtr;
+
+  /**
+   * Metrics of the requests of an endpoint served by the workers.
+   */
+  struct EndpointStatistics
+  {
+    std::size_t requests = 0;
+    std::size_t rejected = 0;
+    std::chrono::steady_clock::duration totalQueueTime{0};
+    std::chrono::steady_clock::duration maxQueueTime{0};
+    std::chrono::steady_clock::duration totalRunTime{0};
+    std::chrono::steady_clock::duration maxRunTime{0};
+  };
+
   static void signalHandler(int sigNum_);
-  static void* serve(void* server_);
   static int delegater(mg_connection *conn_, enum mg_event ev_);
 
-  static volatile int exitFlag;
-  static Handler handler;
+  int onRequest(mg_connection *conn_);
+  int onPoll(mg_connection *conn_);
+  void onClose(mg_connection *conn_);
+
+  void work();
+  RequestPtr nextRequest();
+
+  /**
+   * This function calls the handler for a request taken from the queue and
+   * releases its endpoint slot.
+   */
+  void serveRequest(Request& request_);
+  void logStatistics();
+
+  /**
+   * This function is called by a worker when it has finished a request. It
+   * requests a wakeup of the I/O thread unless one is pending already.
+   */
+  void requestWakeup();
+
+  /**
+   * The function of the waker thread.
+   */
+  void wake();
+
+  /**
+   * Set by the signal handler, which may run on any thread. Lock-free atomics
+   * are safe to use in signal handlers.
+   */
+  static std::atomic_int exitFlag;
   static const unsigned DEFAULT_MAX_THREAD = 20u;
+  static const std::size_t DEFAULT_MAX_QUEUED_REQUESTS = 1024;
 
   std::map<std::string, std::string> _options;
   int _numThreads;
+  int _endpointConcurrency;
+  std::size_t _maxQueuedRequests;
+
+  Handler _handler;
+  Dispatcher _dispatcher;
+  mg_server* _server;
+
+  std::mutex _queueLock;
+  std::condition_variable _queueCond;
+  std::deque<RequestPtr> _queue;
+  std::map<std::string, int> _running;
+  std::map<std::string, EndpointStatistics> _statistics;
+  bool _stopWorkers;
+
+  /**
+   * True if a wakeup has been requested since the I/O thread's last poll.
+   */
+  std::atomic_bool _wakeupPending;
+
+  std::mutex _wakerLock;
+  std::condition_variable _wakerCond;
+  bool _wakeupRequested;
+  bool _stopWaker;
+  std::atomic_bool _wakerDone;
 };
 
 } // mongoose
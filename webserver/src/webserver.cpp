@@ -41,7 +41,22 @@ po::options_description commandLineArguments()
          "This is the path to the folder where the logging output files will be written. "
          "If omitted, the output will be on the console only.")
         ("jobs,j", po::value<int>()->default_value(4),
-         "Number of worker threads.");
+         "Number of worker threads.")
+        ("endpoint-concurrency", po::value<int>()->default_value(0),
+         "Maximum number of worker threads serving the requests of the same "
+         "service at a time. If 0, all but one of the worker threads.")
+        ("max-queued-requests", po::value<std::size_t>()->default_value(1024),
+         "Maximum number of requests waiting for a worker thread. Further "
+         "requests are rejected with 503 Service Unavailable.")
+        ("db-pool-max-connections", po::value<std::size_t>()->default_value(0),
+         "Maximum number of database connections per project. Transactions "
+         "wait for a free connection above this limit. If 0, unlimited.")
+        ("db-pool-min-connections", po::value<std::size_t>()->default_value(0),
+         "Number of database connections per project kept open when idle.")
+        ("db-metrics-interval", po::value<int>()->default_value(60),
+         "Interval in seconds of logging the database metrics of the "
+         "projects: connection pool wait, active transactions and the "
+         "slowest statements. If 0, the metrics are not collected.");
 
     return desc;
 }
@@ -156,6 +171,10 @@ int main(int argc, char* argv[])
     cc::webserver::ThreadedMongoose server(vm["jobs"].as<int>());
     server.setOption("listening_port", std::to_string(vm["port"].as<int>()));
     server.setOption("document_root", vm["webguiDir"].as<std::string>());
+    requestHandler.webguiDir = vm["webguiDir"].as<std::string>();
+    server.setEndpointConcurrency(vm["endpoint-concurrency"].as<int>());
+    server.setMaxQueuedRequests(vm["max-queued-requests"].as<std::size_t>());
+    requestHandler.server = &server;
 
     // Check if certificate.pem exists in the workspace - if so, start SSL.
     auto certPath = fs::path(vm["workspace"].as<std::string>())
@@ -176,7 +195,12 @@ int main(int argc, char* argv[])
 
     try
     {
-        server.run(requestHandler);
+        server.run(
+            requestHandler,
+            [&requestHandler](const mg_connection* conn_)
+            {
+                return requestHandler.endpoint(conn_);
+            });
         LOG(info) << "Exiting, waiting for all threads to finish...";
     }
     catch (const std::exception& ex)
@@ -0,0 +1,424 @@
+#define GTEST_HAS_TR1_TUPLE 1
+#define GTEST_USE_OWN_TR1_TUPLE 0
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "threadedmongoose.h"
+
+using namespace cc::webserver;
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Every test listens on a new port, so that a socket of the previous test
+ * lingering in TIME_WAIT can't make the server start fail.
+ */
+int nextPort()
+{
+  static int port = 18600 + ::getpid() % 1000;
+  return ++port;
+}
+
+/**
+ * Busy waits until the predicate holds or the timeout expires.
+ * @return The value of the predicate.
+ */
+template <typename Predicate>
+bool waitFor(Predicate pred_, std::chrono::seconds timeout_)
+{
+  auto deadline = Clock::now() + timeout_;
+
+  while (!pred_())
+  {
+    if (Clock::now() > deadline)
+      return false;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  return true;
+}
+
+int connectTo(int port_)
+{
+  int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+
+  sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port_);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+  {
+    ::close(sock);
+    return -1;
+  }
+
+  return sock;
+}
+
+/**
+ * Sends a GET request and returns the status code of the response or -1 on
+ * error.
+ */
+int httpGet(int port_, const std::string& uri_)
+{
+  int sock = connectTo(port_);
+  if (sock < 0)
+    return -1;
+
+  std::string request = "GET " + uri_ + " HTTP/1.0\r\n\r\n";
+  ::send(sock, request.data(), request.size(), 0);
+
+  std::string response;
+  char buffer[1024];
+  ssize_t n;
+  while ((n = ::recv(sock, buffer, sizeof(buffer), 0)) > 0)
+    response.append(buffer, n);
+
+  ::close(sock);
+
+  std::size_t space = response.find(' ');
+  return space == std::string::npos
+    ? -1 : std::atoi(response.c_str() + space + 1);
+}
+
+int reply(mg_connection* conn_, const char* body_)
+{
+  mg_send_status(conn_, 200);
+  mg_send_header(conn_, "Content-Type", "text/plain");
+  mg_printf_data(conn_, "%s", body_);
+  return MG_TRUE;
+}
+
+/**
+ * This function returns a server event handler which serves the requests by
+ * the given function.
+ */
+ThreadedMongoose::Handler serve(std::function<int (mg_connection*)> func_)
+{
+  return [func_](mg_connection* conn_, mg_event ev_) -> int
+  {
+    switch (ev_)
+    {
+      case MG_AUTH: return MG_TRUE;
+      case MG_REQUEST: return func_(conn_);
+      default: return MG_FALSE;
+    }
+  };
+}
+
+/**
+ * The endpoint of a request is the first segment of its URI, "static" means
+ * serving on the I/O thread.
+ */
+std::string endpointOf(const mg_connection* conn_)
+{
+  std::string uri = conn_->uri + 1;
+  std::string endpoint = uri.substr(0, uri.find('/'));
+  return endpoint == "static" ? std::string() : endpoint;
+}
+
+}
+
+class ThreadedMongooseTest : public ::testing::Test
+{
+protected:
+  void start(int numThreads_, std::function<int (mg_connection*)> func_)
+  {
+    _port = nextPort();
+    _server.reset(new ThreadedMongoose(numThreads_));
+    _server->setOption("listening_port", std::to_string(_port));
+
+    configure(*_server);
+
+    _thread = std::thread([this, func_]{
+      _ioThread = std::this_thread::get_id();
+      _server->run(serve(func_), endpointOf);
+    });
+
+    ASSERT_TRUE(waitFor([this]{
+      int sock = connectTo(_port);
+      if (sock < 0)
+        return false;
+      ::close(sock);
+      return true;
+    }, std::chrono::seconds(5)));
+  }
+
+  void TearDown() override
+  {
+    if (!_thread.joinable())
+      return;
+
+    // The server stops on SIGTERM.
+    std::raise(SIGTERM);
+    _thread.join();
+  }
+
+  virtual void configure(ThreadedMongoose&) {}
+
+  int _port = 0;
+  std::unique_ptr<ThreadedMongoose> _server;
+  std::thread _thread;
+  std::thread::id _ioThread;
+};
+
+TEST_F(ThreadedMongooseTest, ServesRequestsWithoutEndpointOnIoThread)
+{
+  std::thread::id servedOn;
+
+  start(2, [&servedOn](mg_connection* conn_) {
+    servedOn = std::this_thread::get_id();
+    return reply(conn_, "static");
+  });
+
+  EXPECT_EQ(200, httpGet(_port, "/static/index.html"));
+  EXPECT_EQ(_ioThread, servedOn);
+}
+
+TEST_F(ThreadedMongooseTest, QueuesRequestsForWorkers)
+{
+  std::atomic_int served(0);
+  std::atomic_bool onIoThread(false);
+
+  start(2, [&, this](mg_connection* conn_) {
+    if (std::this_thread::get_id() == _ioThread)
+      onIoThread = true;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ++served;
+    return reply(conn_, "service");
+  });
+
+  // More requests than workers, so some of them wait in the queue.
+  std::vector<int> statuses(8);
+  std::vector<std::thread> clients;
+
+  for (std::size_t i = 0; i < statuses.size(); ++i)
+    clients.emplace_back([&, i, this]{
+      statuses[i] = httpGet(_port, "/service");
+    });
+
+  for (std::thread& client : clients)
+    client.join();
+
+  for (int status : statuses)
+    EXPECT_EQ(200, status);
+
+  EXPECT_EQ(8, served);
+  EXPECT_FALSE(onIoThread);
+}
+
+TEST_F(ThreadedMongooseTest, DeliversRepliesWithoutWaitingForPollTimeout)
+{
+  start(2, [](mg_connection* conn_) {
+    return reply(conn_, "service");
+  });
+
+  // The I/O thread polls once in every second, so the replies would take
+  // seconds without waking it up.
+  Clock::time_point begin = Clock::now();
+
+  for (int i = 0; i < 10; ++i)
+    ASSERT_EQ(200, httpGet(_port, "/service"));
+
+  EXPECT_LT(Clock::now() - begin, std::chrono::seconds(2));
+}
+
+class EndpointLimitTest : public ThreadedMongooseTest
+{
+protected:
+  void configure(ThreadedMongoose& server_) override
+  {
+    server_.setEndpointConcurrency(1);
+  }
+};
+
+TEST_F(EndpointLimitTest, LimitsWorkersPerEndpoint)
+{
+  std::atomic_int running(0);
+  std::atomic_int maxRunning(0);
+
+  start(4, [&](mg_connection* conn_) {
+    if (std::strcmp(conn_->uri, "/slow") == 0)
+    {
+      int current = ++running;
+
+      int max = maxRunning;
+      while (current > max && !maxRunning.compare_exchange_weak(max, current));
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      --running;
+    }
+
+    return reply(conn_, "service");
+  });
+
+  Clock::time_point begin = Clock::now();
+
+  std::vector<Clock::duration> slowDone(4);
+  std::vector<std::thread> clients;
+
+  for (std::size_t i = 0; i < slowDone.size(); ++i)
+    clients.emplace_back([&, i, this]{
+      EXPECT_EQ(200, httpGet(_port, "/slow"));
+      slowDone[i] = Clock::now() - begin;
+    });
+
+  // The slow requests occupy only one worker, so the request of another
+  // endpoint doesn't wait for them.
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  EXPECT_EQ(200, httpGet(_port, "/fast"));
+  Clock::duration fastDone = Clock::now() - begin;
+
+  for (std::thread& client : clients)
+    client.join();
+
+  EXPECT_EQ(1, maxRunning);
+  EXPECT_LT(fastDone, *std::max_element(slowDone.begin(), slowDone.end()));
+}
+
+class QueueLimitTest : public ThreadedMongooseTest
+{
+protected:
+  void configure(ThreadedMongoose& server_) override
+  {
+    server_.setMaxQueuedRequests(1);
+  }
+};
+
+TEST_F(QueueLimitTest, RejectsRequestsWhenQueueIsFull)
+{
+  std::atomic_bool release(false);
+  std::atomic_int started(0);
+
+  start(1, [&](mg_connection* conn_) {
+    ++started;
+    waitFor([&release]{ return release.load(); }, std::chrono::seconds(10));
+    return reply(conn_, "service");
+  });
+
+  // The first request occupies the only worker, the second one fills the
+  // queue.
+  int first = 0;
+  std::thread firstClient([&, this]{ first = httpGet(_port, "/service"); });
+  ASSERT_TRUE(waitFor([&started]{ return started == 1; },
+    std::chrono::seconds(5)));
+
+  int second = 0;
+  std::thread secondClient([&, this]{ second = httpGet(_port, "/service"); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  EXPECT_EQ(503, httpGet(_port, "/service"));
+
+  release = true;
+  firstClient.join();
+  secondClient.join();
+
+  EXPECT_EQ(200, first);
+  EXPECT_EQ(200, second);
+  EXPECT_EQ(2, started);
+}
+
+/**
+ * The "batch" requests serve two "slow" subrequests on the workers and reply
+ * whether both of them have been served.
+ */
+class SubrequestTest : public ThreadedMongooseTest
+{
+protected:
+  void configure(ThreadedMongoose& server_) override
+  {
+    // Every worker may serve a batch at the same time.
+    server_.setEndpointConcurrency(4);
+  }
+
+  void startBatches(int numThreads_)
+  {
+    start(numThreads_, [this](mg_connection* conn_) {
+      if (std::strcmp(conn_->uri, "/slow") == 0)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        return reply(conn_, "slow");
+      }
+
+      std::vector<ThreadedMongoose::Subrequest> subrequests;
+      for (int i = 0; i < 2; ++i)
+      {
+        mg_connection* subrequest = mg_create_subrequest(conn_, "", 0);
+        subrequest->uri = "/slow";
+        subrequests.emplace_back("slow", subrequest);
+      }
+
+      _server->serve(subrequests);
+
+      bool served = true;
+      for (const ThreadedMongoose::Subrequest& subrequest : subrequests)
+      {
+        std::size_t len;
+        mg_get_buffered_reply(subrequest.second, &len);
+        served = served && len > 0;
+        mg_destroy_request_copy(subrequest.second);
+      }
+
+      if (!served)
+        mg_send_status(conn_, 500);
+      return reply(conn_, "batch");
+    });
+  }
+};
+
+TEST_F(SubrequestTest, ServesSubrequestsConcurrently)
+{
+  startBatches(4);
+
+  Clock::time_point begin = Clock::now();
+  EXPECT_EQ(200, httpGet(_port, "/batch"));
+
+  // Serving the subrequests one after the other would take 400 ms.
+  EXPECT_LT(Clock::now() - begin, std::chrono::milliseconds(350));
+}
+
+TEST_F(SubrequestTest, WaitingWorkersServeTheirOwnSubrequests)
+{
+  // Every worker is occupied by a batch, so the subrequests can only be
+  // served by the workers waiting for them.
+  startBatches(2);
+
+  std::vector<int> statuses(2);
+  std::vector<std::thread> clients;
+
+  for (std::size_t i = 0; i < statuses.size(); ++i)
+    clients.emplace_back([&, i, this]{
+      statuses[i] = httpGet(_port, "/batch");
+    });
+
+  for (std::thread& client : clients)
+    client.join();
+
+  for (int status : statuses)
+    EXPECT_EQ(200, status);
+}